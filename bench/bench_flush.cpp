@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2025 - modlog library - https://github.com/igormcoelho/modlog
+
+// Write syscalls per 10k records (1% of them Error), flushing each record
+// (before) against flush policies: 'os' flushed only at Error, and sinks
+// flushed at Error or after 64KiB (FlushPolicy). Syscalls are counted by
+// the kernel (/proc/self/io, Linux only).
+// Usage: bench_flush [dir]
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+//
+#include <modlog/modlog.hpp>
+
+using modlog::LogLevel;
+
+static long write_syscalls() {
+  std::ifstream io{"/proc/self/io"};
+  std::string key;
+  long value = -1;
+  while (io >> key >> value)
+    if (key == "syscw:") return value;
+  return -1;
+}
+
+struct Target {
+  std::ostream* os{nullptr};
+  std::vector<modlog::SinkConfig> sinks;
+  LogLevel flush_level{LogLevel::Debug};
+  modlog::LogConfig log() {
+    return {.os = os, .sinks = sinks, .flush_level = flush_level};
+  }
+};
+
+static void run(const char* name, Target& t) {
+  long before = write_syscalls();
+  for (int k = 0; k < 10000; k++) {
+    if (k % 100 == 99)
+      Log(LogLevel::Error, &t) << "request " << k << " failed";
+    else
+      Log(LogLevel::Info, &t) << "request " << k << " served in " << k % 7
+                              << " ms";
+  }
+  if (t.os) t.os->flush();
+  for (auto& s : t.sinks) s.sink->flush();
+  long after = write_syscalls();
+  std::printf("%-40s %6ld write syscalls / 10k records\n", name,
+              after - before);
+}
+
+auto main(int argc, char* argv[]) -> int {
+  if (write_syscalls() < 0) {
+    std::printf("needs /proc/self/io (Linux)\n");
+    return 0;
+  }
+  std::string dir = argc > 1 ? argv[1] : "/tmp";
+  std::string path = dir + "/modlog_bench_flush.log";
+  static char big[64 * 1024];
+
+  {
+    std::ofstream f{path};
+    Target t{&f};
+    run("os: flush on every record (before)", t);
+  }
+  {
+    std::ofstream f;
+    f.rdbuf()->pubsetbuf(big, sizeof(big));
+    f.open(path);
+    Target t{&f};
+    t.flush_level = LogLevel::Error;
+    run("os: flush_level = Error (after)", t);
+  }
+  {
+    std::ofstream f{path};
+    modlog::OStreamSink sink{f};
+    sink.flush_policy.level = LogLevel::Debug;
+    Target t{nullptr, {{&sink}}};
+    run("sink: flush on every record (before)", t);
+  }
+  {
+    std::ofstream f;
+    f.rdbuf()->pubsetbuf(big, sizeof(big));
+    f.open(path);
+    modlog::OStreamSink sink{f};
+    sink.flush_policy = {LogLevel::Error, 64 * 1024};
+    Target t{nullptr, {{&sink}}};
+    run("sink: Error or 64KiB (after)", t);
+  }
+  {
+    modlog::FileSink file;
+    file.flush_policy.level = LogLevel::Debug;
+    file.open(path);
+    Target t{nullptr, {{&file}}};
+    run("FileSink: flush_policy.level = Debug (before)", t);
+  }
+  {
+    modlog::FileSink file;
+    file.flush_policy.level = LogLevel::Error;
+    file.open(path);
+    Target t{nullptr, {{&file}}};
+    run("FileSink: flush_policy.level = Error (after)", t);
+  }
+  std::filesystem::remove(path);
+  return 0;
+}
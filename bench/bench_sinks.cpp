@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2025 - modlog library - https://github.com/igormcoelho/modlog
+
+// Throughput of file sinks: buffered write(2) (FileSink) against io_uring
+// and pwritev fallback (UringFileSink), for the same formatted records.
+// Usage: bench_sinks [records] [dir]
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+//
+#include <modlog/modlog.hpp>
+
+template <typename Sink>
+double run(Sink& sink, const std::string& path, const std::string& record,
+           long n) {
+  std::filesystem::remove(path);
+  if (!sink.open(path)) return 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (long k = 0; k < n; k++) sink.write(modlog::LogLevel::Info, record);
+  sink.close();
+  auto t1 = std::chrono::steady_clock::now();
+  std::filesystem::remove(path);
+  return std::chrono::duration<double>(t1 - t0).count();
+}
+
+void report(const char* name, double secs, long n, std::size_t bytes) {
+  std::printf("%-22s %8.3f s %12.0f records/s %9.1f MiB/s\n", name, secs,
+              n / secs, bytes / secs / (1024.0 * 1024.0));
+}
+
+auto main(int argc, char* argv[]) -> int {
+  long n = argc > 1 ? std::stol(argv[1]) : 2'000'000;
+  std::string dir = argc > 2 ? argv[2] : "/tmp";
+  std::string path = dir + "/modlog_bench_sinks.log";
+  std::string record =
+      "I20250413 14:34:34.161932 12345 bench_sinks.cpp:42] "
+      "benchmark record with some payload 0123456789abcdef\n";
+  std::size_t bytes = record.size() * static_cast<std::size_t>(n);
+
+  modlog::FileSink file;
+  report("write(2) FileSink", run(file, path, record, n), n, bytes);
+#ifdef MODLOG_HAS_IO_URING
+  modlog::UringFileSink uring;
+  report("io_uring", run(uring, path, record, n), n, bytes);
+  modlog::UringFileSink polled;
+  polled.sqpoll = true;
+  report("io_uring (sqpoll)", run(polled, path, record, n), n, bytes);
+  modlog::UringFileSink fallback;
+  fallback.use_uring = false;
+  report("pwritev fallback", run(fallback, path, record, n), n, bytes);
+#else
+  std::printf("io_uring unavailable on this platform\n");
+#endif
+  return 0;
+}
@@ -20,9 +20,8 @@ auto main() -> int {
   // enable JSON logging
   modlog::modlog_default.fprefixdata = modlog::json_prefix;
 
-  Log(Info) << "Hello World!";
-  // finish json!
-  *modlog::modlog_default.os << "\"}";
+  // finish json on same record!
+  Log(Info) << "Hello World!" << "\"}";
 
   modlog::modlog_default.minlog = modlog::LogLevel::Disabled;
 
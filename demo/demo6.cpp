@@ -21,9 +21,8 @@ auto main() -> int {
   // enable JSON logging
   modlog::modlog_default.fprefixdata = modlog::json_prefix;
 
-  Log(Info) << "Hello World!";
-  // finish json!
-  *modlog::modlog_default.os << "\"}";
+  // finish json on same record!
+  Log(Info) << "Hello World!" << "\"}";
 
   return 0;
 }
\ No newline at end of file
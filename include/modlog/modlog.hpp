@@ -7,21 +7,63 @@
 //
 #ifndef MODLOG_USE_CXX_MODULES
 #ifndef _WIN32
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <poll.h>
 #include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
+#if __has_include(<execinfo.h>)
+#include <execinfo.h>
+#define MODLOG_HAS_EXECINFO 1
+#endif
+#if defined(__linux__)
+#include <sys/syscall.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define MODLOG_HAS_IO_URING 1
+#endif
+#endif
 #else
+#include <fcntl.h>
+#include <io.h>
+#include <process.h>
+#include <sys/stat.h>
 #include <windows.h>
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <deque>
 #include <filesystem>
+#include <fstream>
 #if __cplusplus >= 202002L && __has_include(<format>)
 #include <format>
 #define MODLOG_USE_STD_FORMAT 1
 #endif
 #include <functional>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #if __cplusplus >= 202002L && __has_include(<source_location>)
 #include <source_location>
@@ -29,6 +71,10 @@
 #endif
 #include <string>
 #include <thread>  // for std::terminate
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #if __cplusplus >= 202002L && __has_include(<concepts>)
 #include <concepts>
@@ -64,23 +110,154 @@ struct my_source_location {
   my_source_location { __FILE__, __LINE__ }
 #endif
 
-inline uintptr_t get_tid() {
+// =======================================
+//         cached thread identity
+// =======================================
+
+// How threads are identified on log prefixes:
+// - Native: opaque pthread_self() handle (legacy, long and hard to read)
+// - Kernel: kernel thread id, same as gettid() seen on top/perf (default)
+// - Index: short sequential index (1, 2, 3...) in order of first log
+// - Name: name given by set_thread_name(), or kernel id if unnamed
+MODLOG_MOD_EXPORT enum class ThreadIdMode : int {
+  Native = 0,
+  Kernel = 1,
+  Index = 2,
+  Name = 3
+};
+
+MODLOG_MOD_EXPORT inline std::atomic<ThreadIdMode> thread_id_mode{
+    ThreadIdMode::Kernel};
+
+inline std::atomic<std::uintptr_t> thread_index_counter{0};
+
+inline std::uintptr_t get_native_tid() {
 #ifdef _WIN32
-  return static_cast<uintptr_t>(::GetCurrentThreadId());
+  return static_cast<std::uintptr_t>(::GetCurrentThreadId());
 #else
   pthread_t tid = pthread_self();
 // On ARM, pthread_t is 'long unsigned int', uintptr_t is 'unsigned int'
 // On Mac, pthread_t is '_opaque_pthread_t *', uintptr_t is 'unsigned long'
 // On linux, pthread_t is 'unsigned long', uintptr_t is 'unsigned long'
 #if defined(__APPLE__) || defined(__FreeBSD__)
-  return reinterpret_cast<uintptr_t>(
+  return reinterpret_cast<std::uintptr_t>(
       tid);  // mac and freebsd (but Linux ok too...)
 #elif defined(__arm__) || defined(__aarch64__)
-  return static_cast<uintptr_t>(tid);  // ARM! (but Linux ok too...)
+  return static_cast<std::uintptr_t>(tid);  // ARM! (but Linux ok too...)
+#else
+  return static_cast<std::uintptr_t>(tid);  // default...
+#endif
+
+#endif
+}
+
+inline std::uintptr_t get_kernel_tid() {
+#if defined(_WIN32)
+  return static_cast<std::uintptr_t>(::GetCurrentThreadId());
+#elif defined(__linux__)
+  return static_cast<std::uintptr_t>(::syscall(SYS_gettid));
+#elif defined(__APPLE__)
+  std::uint64_t tid = 0;
+  ::pthread_threadid_np(nullptr, &tid);
+  return static_cast<std::uintptr_t>(tid);
 #else
-  return static_cast<uintptr_t>(tid);  // default...
+  return get_native_tid();
 #endif
+}
+
+// numeric thread id and its preformatted label (id or thread name)
+MODLOG_MOD_EXPORT struct ThreadLabel {
+  std::uintptr_t id{0};
+  char label[32]{};
+  std::uint8_t len{0};
+  bool numeric{true};
+
+  std::string_view view() const { return {label, len}; }
+};
+
+// per-thread identity, computed and formatted only once per thread
+// (and again only if thread_id_mode or the thread name changes)
+struct ThreadInfo {
+  std::uintptr_t native{0};
+  std::uintptr_t kernel{0};
+  std::uintptr_t index{0};
+  std::string name;
+  // id and label for the current mode
+  ThreadLabel current;
+  int mode{-1};
+
+  ThreadInfo()
+      : native{get_native_tid()},
+        kernel{get_kernel_tid()},
+        index{++thread_index_counter} {}
+
+  void update(ThreadIdMode m) {
+    mode = static_cast<int>(m);
+    auto& t = current;
+    t.numeric = true;
+    if (m == ThreadIdMode::Native)
+      t.id = native;
+    else if (m == ThreadIdMode::Index)
+      t.id = index;
+    else
+      t.id = kernel;
+    if (m == ThreadIdMode::Name && !name.empty()) {
+      t.len = static_cast<std::uint8_t>(name.copy(t.label, sizeof(t.label)));
+      t.numeric = false;
+    } else {
+      auto r = std::to_chars(t.label, t.label + sizeof(t.label), t.id);
+      t.len = static_cast<std::uint8_t>(r.ptr - t.label);
+    }
+  }
+};
+
+inline ThreadInfo& this_thread_info() {
+  thread_local ThreadInfo info;
+  auto m = thread_id_mode.load(std::memory_order_relaxed);
+  if (info.mode != static_cast<int>(m)) info.update(m);
+  return info;
+}
+
+// label of the record being rendered on behalf of another thread
+// (used by async backend, so prefix functions see producer thread label)
+inline const ThreadLabel*& rendering_thread() {
+  thread_local const ThreadLabel* t = nullptr;
+  return t;
+}
+
+inline const ThreadLabel* find_thread_label(std::uintptr_t tid) {
+  auto* r = rendering_thread();
+  if (r && r->id == tid) return r;
+  auto& info = this_thread_info();
+  if (info.current.id == tid) return &info.current;
+  return nullptr;
+}
 
+// numeric thread id, according to thread_id_mode
+inline std::uintptr_t get_tid() { return this_thread_info().current.id; }
+
+// preformatted thread id (or thread name) of calling thread
+MODLOG_MOD_EXPORT inline std::string_view thread_label() {
+  return this_thread_info().current.view();
+}
+
+// preformatted label for 'tid', cached when it belongs to calling thread
+MODLOG_MOD_EXPORT inline std::string_view thread_label(std::uintptr_t tid) {
+  if (auto* t = find_thread_label(tid)) return t->view();
+  thread_local char buf[24];
+  auto r = std::to_chars(buf, buf + sizeof(buf), tid);
+  return {buf, static_cast<std::size_t>(r.ptr - buf)};
+}
+
+// names calling thread (truncated to 31 chars), shown on ThreadIdMode::Name
+MODLOG_MOD_EXPORT inline void set_thread_name(std::string_view name) {
+  auto& info = this_thread_info();
+  info.name = name.substr(0, sizeof(ThreadLabel::label) - 1);
+  info.update(static_cast<ThreadIdMode>(info.mode));
+#if defined(__linux__)
+  // kernel limits names to 15 chars, so it also appears on top/perf
+  std::string kname = info.name.substr(0, 15);
+  ::pthread_setname_np(::pthread_self(), kname.c_str());
 #endif
 }
 
@@ -163,336 +340,5524 @@ MODLOG_MOD_EXPORT using modlog::LogLevel::Disabled;
 #endif
 
 // =======================================
-//             handling Fatal
+//       log sinks and file logging
 // =======================================
-struct FatalStream : private std::streambuf, public std::ostream {
+
+// when a sink is flushed, besides its own buffering (e.g., FileSink); sinks
+// that buffer records set their own defaults
+MODLOG_MOD_EXPORT struct FlushPolicy {
+  // after a record at or above it
+  LogLevel level{LogLevel::Disabled};
+  // after this many bytes since last flush (0: off)
+  std::size_t bytes{0};
+  // periodically, once sink is added to flush_timer (0: off); FileSink,
+  // UringFileSink and SyslogSink add themselves on open
+  std::chrono::milliseconds interval{0};
+};
+
+// receives complete records (prefix + message + line break)
+MODLOG_MOD_EXPORT struct LogSink {
+  virtual ~LogSink() = default;
+  virtual void write(LogLevel l, std::string_view record) = 0;
+  // same as write(), with time of record (e.g., for time rotation)
+  virtual void write_at(LogLevel l, std::string_view record,
+                        std::chrono::system_clock::time_point time) {
+    (void)time;
+    write(l, record);
+  }
+  virtual void flush() {}
+  // flushes and releases resources (called by StopLogs())
+  virtual void close() { flush(); }
+  // (crash handler) writes buffered records and 'record' only with
+  // async-signal-safe calls and without locking, if possible
+  virtual void crash_write(std::string_view record) { (void)record; }
+
+  FlushPolicy flush_policy;
+
+  // (after each record written to it) flushes by level or size policy
+  void written(LogLevel l, std::size_t n) {
+    if (l >= flush_policy.level ||
+        (flush_policy.bytes > 0 &&
+         unflushed.fetch_add(n, std::memory_order_relaxed) + n >=
+             flush_policy.bytes)) {
+      unflushed.store(0, std::memory_order_relaxed);
+      flush();
+    }
+  }
+
  private:
-  std::stringstream buffer;
+  std::atomic<std::size_t> unflushed{0};
+};
 
+// writes records to a std::ostream (e.g., a console output with its own
+// level threshold and format, see LogConfig::sinks)
+MODLOG_MOD_EXPORT class OStreamSink : public LogSink {
  public:
-  explicit FatalStream() : std::ostream{this} {}
+  explicit OStreamSink(std::ostream& _os) : os{&_os} {}
 
- private:
-  int overflow(int c) override {
-    buffer.put((char)c);
-    if (c == '\n') kill();
-    return c;
+  void write(LogLevel, std::string_view record) override {
+    std::lock_guard<std::mutex> lock{mtx};
+    os->write(record.data(), static_cast<std::streamsize>(record.size()));
   }
 
-  void kill() {
-    std::cerr << buffer.str() << std::endl;
-#if MODLOG_STACKTRACE && defined(__cpp_lib_stacktrace)
-    std::cerr << std::stacktrace::current() << std::endl;
-#else
-    std::cerr << "WARNING: stacktrace unavailable, must #include <stacktrace> "
-                 "and -lstdc++exp"
-              << std::endl;
-#endif
-    std::terminate();
+  void flush() override {
+    std::lock_guard<std::mutex> lock{mtx};
+    os->flush();
   }
+
+ private:
+  std::mutex mtx;
+  std::ostream* os;
 };
 
-MODLOG_MOD_EXPORT inline FatalStream fatal;
+// writes 'v' as 'width' zero-padded digits, returning end of output
+inline char* put_digits(char* p, std::uint64_t v, int width) {
+  for (int i = width - 1; i >= 0; i--) {
+    p[i] = static_cast<char>('0' + v % 10);
+    v /= 10;
+  }
+  return p + width;
+}
 
-// =======================================
-//         helper prefix function
-// =======================================
+// writes 'v' as a LEB128 varint (up to 10 bytes), returning end of output
+inline char* put_varint(char* p, std::uint64_t v) {
+  while (v >= 0x80) {
+    *p++ = static_cast<char>(v | 0x80);
+    v >>= 7;
+  }
+  *p++ = static_cast<char>(v);
+  return p;
+}
 
-MODLOG_MOD_EXPORT inline std::ostream& default_prefix_data(
-    std::ostream& os, LogLevel l, tm now_tm, std::chrono::microseconds us,
-    uintptr_t tid, std::string_view short_file, int line, bool debug) {
-  // TODO: check if locking is required for multi-threaded setups...
-  char level = '?';
-  if (l == LogLevel::Debug)
-    level = 'D';
-  else if (l == LogLevel::Info)
-    level = 'I';
-  else if (l == LogLevel::Warning)
-    level = 'W';
-  else if (l == LogLevel::Error)
-    level = 'E';
-  else if (l == LogLevel::Fatal)
-    level = 'F';
+// reads a LEB128 varint at 'pos' of 's', advancing 'pos'
+inline bool get_varint(std::string_view s, std::size_t& pos,
+                       std::uint64_t& v) {
+  v = 0;
+  for (int shift = 0; pos < s.size() && shift < 64; shift += 7) {
+    auto b = static_cast<unsigned char>(s[pos++]);
+    v |= static_cast<std::uint64_t>(b & 0x7f) << shift;
+    if (b < 0x80) return true;
+  }
+  return false;
+}
 
-  // add line break before, since we cannot control what's done after...
-  os << std::endl;
-// #if defined(__cpp_lib_format)
-#ifdef MODLOG_USE_STD_FORMAT
-  os << std::format("{}{:04}{:02}{:02} {:02}:{:02}:{:02}.{:06} {:}", level,
-                    now_tm.tm_year + 1900, now_tm.tm_mon + 1, now_tm.tm_mday,
-                    now_tm.tm_hour, now_tm.tm_min, now_tm.tm_sec, us.count(),
-                    tid);
+// local wall-clock time 'tm' (plus 'us') as microseconds since 1970-01-01
+// 00:00 (no time zone applied, so it matches the time shown on text logs)
+MODLOG_MOD_EXPORT inline std::int64_t wall_time_us(
+    const std::tm& tm, std::chrono::microseconds us = {}) {
+  // days from civil date (proleptic Gregorian calendar)
+  std::int64_t y = tm.tm_year + 1900 - (tm.tm_mon < 2);
+  std::int64_t era = (y >= 0 ? y : y - 399) / 400;
+  std::int64_t yoe = y - era * 400;
+  std::int64_t m = tm.tm_mon + 1;
+  std::int64_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + tm.tm_mday - 1;
+  std::int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  std::int64_t days = era * 146097 + doe - 719468;
+  std::int64_t secs =
+      days * 86400 + tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec;
+  return secs * 1'000'000 + us.count();
+}
+
+inline int file_open_append(const std::string& path) {
+#ifdef _WIN32
+  return ::_open(path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY,
+                 _S_IREAD | _S_IWRITE);
 #else
-  os << level << std::setw(4) << std::setfill('0') << (now_tm.tm_year + 1900)
-     << std::setw(2) << std::setfill('0') << (now_tm.tm_mon + 1) << std::setw(2)
-     << std::setfill('0') << now_tm.tm_mday << ' ' << std::setw(2)
-     << std::setfill('0') << now_tm.tm_hour << ':' << std::setw(2)
-     << std::setfill('0') << now_tm.tm_min << ':' << std::setw(2)
-     << std::setfill('0') << now_tm.tm_sec << '.' << std::setw(6)
-     << std::setfill('0') << us.count() << ' ' << tid;
+  return ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0664);
 #endif
+}
 
-// #if defined(__cpp_lib_format)
-#ifdef MODLOG_USE_STD_FORMAT
-
-  if (!short_file.empty())
-    os << std::format(" {}:{}] ", short_file, line);
-  else
-    os << std::format("] ");
+// writes all bytes, retrying on partial writes and EINTR
+inline bool file_write_all(int fd, const char* data, std::size_t n) {
+  while (n > 0) {
+#ifdef _WIN32
+    auto r = ::_write(fd, data, static_cast<unsigned>(n));
 #else
-  if (!short_file.empty()) {
-    os << " " << short_file << ":" << line << "] ";
-  } else {
-    os << "] ";
-  }
+    auto r = ::write(fd, data, n);
 #endif
-
-  return (level == 'F') ? fatal : os;
+    if (r < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += r;
+    n -= static_cast<std::size_t>(r);
+  }
+  return true;
 }
 
-MODLOG_MOD_EXPORT inline std::ostream& json_prefix(
-    std::ostream& os, LogLevel l, tm now_tm, std::chrono::microseconds us,
-    uintptr_t tid, std::string_view short_file, int line, bool debug) {
-  // TODO: check if locking is required for multi-threaded setups...
-  std::string slevel;
-  if (l == LogLevel::Debug)
-    slevel = "debug";
-  else if (l == LogLevel::Info)
-    slevel = "info";
-  else if (l == LogLevel::Warning)
-    slevel = "warn";
-  else if (l == LogLevel::Error)
-    slevel = "error";
-  else if (l == LogLevel::Fatal)
-    slevel = "fatal";
-  if (debug) slevel = "debug";
-
-// #if defined(__cpp_lib_format)
-#ifdef MODLOG_USE_STD_FORMAT
-  std::string stime =
-      std::format("{:04}{:02}{:02} {:02}:{:02}:{:02}.{:06}",
-                  now_tm.tm_year + 1900, now_tm.tm_mon + 1, now_tm.tm_mday,
-                  now_tm.tm_hour, now_tm.tm_min, now_tm.tm_sec, us.count());
+inline void file_close(int fd) {
+#ifdef _WIN32
+  ::_close(fd);
 #else
-  std::stringstream ss;
-  ss << std::setw(4) << std::setfill('0') << (now_tm.tm_year + 1900)
-     << std::setw(2) << std::setfill('0') << (now_tm.tm_mon + 1) << std::setw(2)
-     << std::setfill('0') << now_tm.tm_mday << ' ' << std::setw(2)
-     << std::setfill('0') << now_tm.tm_hour << ':' << std::setw(2)
-     << std::setfill('0') << now_tm.tm_min << ':' << std::setw(2)
-     << std::setfill('0') << now_tm.tm_sec << '.' << std::setw(6)
-     << std::setfill('0') << us.count();
-  std::string stime = ss.str();
+  ::close(fd);
 #endif
-  os << "{\"level\":\"" << slevel << "\", \"timestamp\":\"" << stime << "\", ";
+}
 
-  if (!short_file.empty())
-    os << "\"caller\":\"" << short_file << ":" << line << "\", ";
+inline std::size_t file_size(int fd) {
+#ifdef _WIN32
+  auto n = ::_lseeki64(fd, 0, SEEK_END);
+#else
+  auto n = ::lseek(fd, 0, SEEK_END);
+#endif
+  return n < 0 ? 0 : static_cast<std::size_t>(n);
+}
 
-  os << "\"tid\":" << tid << ", ";
+// reserves blocks for 'n' bytes after end of file, keeping its size
+// (only on Linux, elsewhere it does nothing)
+inline void file_preallocate([[maybe_unused]] int fd,
+                             [[maybe_unused]] std::size_t n) {
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+  [[maybe_unused]] int r =
+      ::fallocate(fd, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(file_size(fd)),
+                  static_cast<off_t>(n));
+#endif
+}
 
-  os << "\"msg\":\"";
-  return (l == LogLevel::Fatal) ? fatal : os;
+// releases blocks preallocated after end of file
+inline void file_trim([[maybe_unused]] int fd) {
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+  [[maybe_unused]] int r =
+      ::ftruncate(fd, static_cast<off_t>(file_size(fd)));
+#endif
 }
 
-MODLOG_MOD_EXPORT class LogConfig {
+// Writes each record with a single write(2) and no lock, so records of
+// concurrent threads never interleave: on a file opened by open() (with
+// O_APPEND), each write lands at end of file, also with other processes
+// appending to it; on pipes, writes up to PIPE_BUF bytes are atomic. There
+// is no user-space buffer, so each record costs a syscall (see FileSink).
+MODLOG_MOD_EXPORT class FdSink : public LogSink {
  public:
-  std::ostream* os{&std::cerr};
-  // OBS: could host a unique_ptr here, if necessary for thirdparty streams
-  // OBS 2: not necessary for the moment... if you need it, just let us know!
-  LogLevel minlog{LogLevel::Info};
-  int vlevel{0};
-  bool prefix{true};
-  NullOStream no;
-  using FuncLogPrefix = std::function<std::ostream&(
-      std::ostream&, LogLevel, std::tm, std::chrono::microseconds,
-      std::uintptr_t, std::string_view, int, bool)>;
-  FuncLogPrefix fprefixdata{default_prefix_data};
+  FdSink() = default;
+  // existing descriptor (e.g., 2 for stderr, or a pipe), kept open on close
+  explicit FdSink(int _fd) : fd{_fd} {}
+  FdSink(const FdSink&) = delete;
+  FdSink& operator=(const FdSink&) = delete;
+  ~FdSink() override { close(); }
 
-  std::string getFilename(std::string_view vpath) {
-    std::string path{vpath};
-    auto pos = path.find_last_of("/\\");
-    if (pos != std::string::npos)
-      return path.substr(pos + 1);
-    else
-      return path;
-#if 0
-    return std::filesystem::path(vpath).filename().string();
-#endif
+  bool open(const std::string& path) {
+    close();
+    int f = file_open_append(path);
+    if (f < 0) return false;
+    owned = true;
+    fd.store(f, std::memory_order_release);
+    return true;
   }
 
-  std::ostream& fprefix(std::ostream* os, LogLevel l, std::string_view path,
-                        int line, bool debug) {
-    // add line break before, since we cannot control what's done after...
-    // *os << std::endl;
-    using namespace std::chrono;  // NOLINT
+  bool is_open() const { return fd.load(std::memory_order_acquire) >= 0; }
 
-    auto now = system_clock::now();
-    auto now_time_t = system_clock::to_time_t(now);
-    auto now_tm = *std::localtime(&now_time_t);
-    auto us = duration_cast<microseconds>(now.time_since_epoch()) % 1'000'000;
-    auto tid = get_tid();
-    std::string short_file = "";
-    if (!path.empty()) short_file = getFilename(path);
+  void write(LogLevel, std::string_view record) override {
+    int f = fd.load(std::memory_order_relaxed);
+    if (f >= 0) file_write_all(f, record.data(), record.size());
+  }
 
-    // =====================================
-    // use personalized prefix data function
-    // =====================================
+  void close() override {
+    int f = fd.exchange(-1, std::memory_order_acq_rel);
+    if (f >= 0 && owned) file_close(f);
+    owned = false;
+  }
 
-    // TODO: does fprefixdata needs to "return" ostream?
-    // will it handle fatal too? for now, leaving both options...
-    auto& os2 =
-        this->fprefixdata(*os, l, now_tm, us, tid, short_file, line, debug);
-    // TODO: dump 'os2' into Fatal or not?
-    // TODO 2: decide later... better to keep automatic Fatal for now!
-    return (l == LogLevel::Fatal) ? fatal : os2;
+  void crash_write(std::string_view record) override {
+    write(LogLevel::Fatal, record);
   }
+
+ private:
+  std::atomic<int> fd{-1};
+  bool owned{false};
 };
 
-MODLOG_MOD_EXPORT inline LogConfig modlog_default;
+#ifndef _WIN32
+// incremented in child processes after fork(), so cached pids are refreshed
+inline std::atomic<unsigned> fork_generation{0};
 
-// #ifdef __cpp_concepts
-#ifdef MODLOG_USE_STD_CONCEPTS
-template <typename Self>
-concept Loggable = requires(Self obj) {
-  { obj.stream() } -> std::same_as<std::ostream&>;
-  { obj.log() } -> std::same_as<LogLevel>;
-  { obj.prefix() } -> std::same_as<bool>;
-} || requires(Self obj) {
-  { obj.log() } -> std::same_as<LogConfig>;
+// pid of the calling process and its "[pid] " header
+struct ProcessId {
+  long pid;
+  std::string_view header;
 };
-#else
-#define Loggable typename
-#endif
 
-// ==============================
-// logs with global configuration
-// ==============================
-
-MODLOG_MOD_EXPORT inline std::ostream& Log(
-    LogLevel sev = LogLevel::Info,
-    // const std::source_location location = std::source_location::current()) {
-    const my_source_location location = MY_SOURCE_LOCATION()) {
-  if (modlog_default.minlog == LogLevel::Disabled) return modlog_default.no;
-#ifdef NDEBUG
-  if (sev < LogLevel::Info) return modlog_default.no;
-#endif
-  return (sev < modlog_default.minlog)
-             ? modlog_default.no
-             : (modlog_default.prefix
-                    ? modlog_default.fprefix(modlog_default.os, sev,
-                                             location.file_name(),
-                                             location.line(), false)
-                    : *modlog_default.os);
+// (cached per thread, refreshed after fork())
+inline ProcessId this_process() {
+  static std::once_flag once;
+  std::call_once(once, []() {
+    ::pthread_atfork(nullptr, nullptr, []() {
+      fork_generation.fetch_add(1, std::memory_order_relaxed);
+    });
+  });
+  thread_local unsigned gen = ~0u;
+  thread_local long pid = 0;
+  thread_local char buf[32];
+  thread_local std::size_t len = 0;
+  unsigned g = fork_generation.load(std::memory_order_relaxed);
+  if (g != gen) {
+    pid = static_cast<long>(::getpid());
+    buf[0] = '[';
+    auto r = std::to_chars(buf + 1, buf + sizeof(buf) - 2, pid);
+    r.ptr[0] = ']';
+    r.ptr[1] = ' ';
+    len = static_cast<std::size_t>(r.ptr + 2 - buf);
+    gen = g;
+  }
+  return {pid, {buf, len}};
 }
 
-// ===============================
-// vlogs with global configuration
-// ===============================
+// Log file shared by several processes (e.g., forked workers), with no lock:
+// each record is a single write(2) of at most 'atomic_size' bytes (PIPE_BUF)
+// on an O_APPEND descriptor, so records never interleave. Longer records are
+// split into fragments "{pid.seq i/n len} <len bytes>\n", which may interleave
+// with other records and are joined again by reassemble() and demux().
+// With 'process_header', each line starts with "[pid] ", so demux() can
+// separate the output of each process.
+MODLOG_MOD_EXPORT class SharedFileSink : public LogSink {
+ public:
+  bool process_header{false};
+  std::size_t atomic_size{PIPE_BUF};
 
-MODLOG_MOD_EXPORT inline std::ostream& VLog(
-    int vlevel,
-    // const std::source_location location = std::source_location::current()) {
-    const my_source_location location = MY_SOURCE_LOCATION()) {
-  if (modlog_default.minlog == LogLevel::Disabled) return modlog_default.no;
-#ifdef NDEBUG
-  if (vlevel > 0) return modlog_default.no;
-#endif
-  return (LogLevel::Info < modlog_default.minlog) ||
-                 (vlevel > modlog_default.vlevel)
-             ? modlog_default.no
-             : (modlog_default.prefix
-                    ? modlog_default.fprefix(modlog_default.os, LogLevel::Info,
-                                             location.file_name(),
-                                             location.line(), true)
-                    : *modlog_default.os);
-}
+  SharedFileSink() = default;
+  SharedFileSink(const SharedFileSink&) = delete;
+  SharedFileSink& operator=(const SharedFileSink&) = delete;
+  ~SharedFileSink() override { close(); }
 
-// =======================================
-// logs with object-specific configuration
-// =======================================
+  // opened before fork(), the descriptor is shared with children
+  bool open(const std::string& path) {
+    close();
+    int f = file_open_append(path);
+    if (f < 0) return false;
+    fd.store(f, std::memory_order_release);
+    return true;
+  }
 
-/*
-// No "Default" logging for objects
-MODLOG_MOD_EXPORT template <Loggable LogObj>
-inline std::ostream& Log(
-    LogObj* lo,
-    // const std::source_location location = std::source_location::current()) {
-    const my_source_location location = MY_SOURCE_LOCATION()) {
-  return (LogLevel::Info < lo->log().minlog)
-             ? modlog_default.no
-             : (lo->log().prefix
-                    ? modlog_default.fprefix(lo->log().os, LogLevel::Info,
-                                             location.file_name(),
-                                             location.line(), false)
-                    : *lo->log().os);
-}
-*/
+  bool is_open() const { return fd.load(std::memory_order_acquire) >= 0; }
 
-MODLOG_MOD_EXPORT template <Loggable LogObj>
-inline std::ostream& Log(
-    LogLevel sev, LogObj* lo,
-    // const std::source_location location = std::source_location::current()) {
-    const my_source_location location = MY_SOURCE_LOCATION()) {
-  if (lo->log().minlog == LogLevel::Disabled) return modlog_default.no;
-#ifdef NDEBUG
-  if (sev < LogLevel::Info) return modlog_default.no;
-#endif
-  return (sev < lo->log().minlog)
-             ? modlog_default.no
-             : (lo->log().prefix
-                    ? lo->log().fprefix(lo->log().os, sev, location.file_name(),
-                                        location.line(), false)
-                    : *lo->log().os);
-}
+  void write(LogLevel, std::string_view record) override {
+    int f = fd.load(std::memory_order_relaxed);
+    if (f < 0 || record.empty()) return;
+    ProcessId id = this_process();
+    std::string_view hdr = process_header ? id.header : "";
+    if (process_header && record.find('\n') < record.size() - 1) {
+      // multi-line record: header on every line
+      thread_local std::string buf;
+      buf.clear();
+      std::size_t p = 0;
+      while (p < record.size()) {
+        std::size_t e = std::min(record.find('\n', p), record.size() - 1);
+        buf.append(hdr).append(record.substr(p, e + 1 - p));
+        p = e + 1;
+      }
+      if (buf.size() <= atomic_size) {
+        file_write_all(f, buf.data(), buf.size());
+        return;
+      }
+    } else if (hdr.size() + record.size() <= atomic_size) {
+      write_parts(f, hdr, record);
+      return;
+    }
+    write_fragments(f, id.pid, hdr, record);
+  }
 
-// ================================
-//    support for file logging
-// ================================
+  void close() override {
+    int f = fd.exchange(-1, std::memory_order_acq_rel);
+    if (f >= 0) file_close(f);
+  }
 
-inline void StartLogs(std::string_view app_name) {
-  // TODO: create temporary log files
-  Log(LogLevel::Warning)
-      << "WARNING: modlog does not currently support file logging!";
-}
+  void crash_write(std::string_view record) override {
+    write(LogLevel::Fatal, record);
+  }
 
-inline void StopLogs() {
-  // flush last line!
-  *modlog_default.os << std::endl;
-}
+  // file contents with fragmented records joined (and their header restored)
+  static std::string reassemble(std::string_view text) {
+    std::string out;
+    parse(text, [&out](long pid, bool header, std::string_view rec) {
+      if (header) out.append("[").append(std::to_string(pid)).append("] ");
+      out.append(rec);
+    });
+    return out;
+  }
 
-// ================================
-//     semantic stream - utils
-// ================================
+  // output of each process (in order of first record), without headers;
+  // lines with no "[pid] " header go to pid 0
+  static std::vector<std::pair<long, std::string>> demux(
+      std::string_view text) {
+    std::vector<std::pair<long, std::string>> out;
+    parse(text, [&out](long pid, bool header, std::string_view rec) {
+      if (!header) pid = 0;
+      auto it = std::find_if(out.begin(), out.end(),
+                             [pid](const auto& p) { return p.first == pid; });
+      if (it == out.end()) it = out.insert(out.end(), {pid, std::string{}});
+      it->second.append(rec);
+    });
+    return out;
+  }
 
-struct SemStream : private std::streambuf, public std::ostream {
  private:
-  std::stringstream oss;
+  std::atomic<int> fd{-1};
+  std::atomic<std::uint64_t> seq{0};
 
- public:
-  std::ostream* os;
+  // writes up to three pieces with one writev (atomic on O_APPEND)
+  static void write_parts(int f, std::string_view a, std::string_view b,
+                          std::string_view c = {}) {
+    iovec iov[3];
+    int n = 0;
+    std::size_t total = 0;
+    for (auto p : {a, b, c}) {
+      if (p.empty()) continue;
+      iov[n].iov_base = const_cast<char*>(p.data());
+      iov[n++].iov_len = p.size();
+      total += p.size();
+    }
+    ssize_t r;
+    while ((r = ::writev(f, iov, n)) < 0 && errno == EINTR) {
+    }
+    if (r < 0 || static_cast<std::size_t>(r) == total) return;
+    // short write (disk full or signal): finish the rest
+    for (int i = 0; i < n; ++i) {
+      auto len = static_cast<std::size_t>(r);
+      if (len >= iov[i].iov_len) {
+        r -= static_cast<ssize_t>(iov[i].iov_len);
+        continue;
+      }
+      file_write_all(f, static_cast<const char*>(iov[i].iov_base) + len,
+                     iov[i].iov_len - len);
+      r = 0;
+    }
+  }
+
+  void write_fragments(int f, long pid, std::string_view hdr,
+                       std::string_view record) {
+    // fragment header (with "[pid] ") is less than 160 bytes
+    std::size_t chunk = atomic_size > 320 ? atomic_size - 160 : 160;
+    std::size_t n = (record.size() + chunk - 1) / chunk;
+    std::uint64_t s = seq.fetch_add(1, std::memory_order_relaxed);
+    char buf[160];
+    std::size_t h = std::min<std::size_t>(hdr.size(), 32);
+    std::memcpy(buf, hdr.data(), h);
+    for (std::size_t i = 0; i < n; ++i) {
+      auto part = record.substr(i * chunk, chunk);
+      int k = std::snprintf(buf + h, sizeof(buf) - h, "{%ld.%llu %zu/%zu %zu} ",
+                            pid, static_cast<unsigned long long>(s), i + 1, n,
+                            part.size());
+      if (k < 0) return;
+      write_parts(f, {buf, h + static_cast<std::size_t>(k)}, part, "\n");
+    }
+  }
+
+  // reads a number at 'p' followed by 'sep', advancing 'p'
+  static bool parse_num(std::string_view t, std::size_t& p, char sep,
+                        std::uint64_t& v) {
+    auto r = std::from_chars(t.data() + p, t.data() + t.size(), v);
+    if (r.ec != std::errc{} || r.ptr == t.data() + t.size() || *r.ptr != sep)
+      return false;
+    p = static_cast<std::size_t>(r.ptr - t.data()) + 1;
+    return true;
+  }
+
+  // calls out(pid, has_header, record) for each line or joined record
+  template <class F>
+  static void parse(std::string_view t, F out) {
+    struct Pending {
+      std::uint64_t pid, seq;
+      std::string data;
+    };
+    std::vector<Pending> pending;
+    std::size_t p = 0;
+    while (p < t.size()) {
+      std::uint64_t pid = 0, fpid, s, i, n, len;
+      std::size_t q = p;
+      bool header = t[q] == '[' && parse_num(t, ++q, ']', pid) &&
+                    q < t.size() && t[q] == ' ';
+      if (header)
+        p = q + 1;
+      else
+        pid = 0;
+      q = p;
+      if (q < t.size() && t[q] == '{' && parse_num(t, ++q, '.', fpid) &&
+          parse_num(t, q, ' ', s) && parse_num(t, q, '/', i) &&
+          parse_num(t, q, ' ', n) && parse_num(t, q, '}', len) &&
+          q < t.size() && t[q] == ' ' && q + 1 + len <= t.size()) {
+        auto part = t.substr(q + 1, len);
+        p = q + 1 + len + 1;
+        auto it = std::find_if(pending.begin(), pending.end(), [&](auto& e) {
+          return e.pid == fpid && e.seq == s;
+        });
+        if (it == pending.end())
+          it = pending.insert(pending.end(), {fpid, s, std::string{}});
+        it->data.append(part);
+        if (i == n) {
+          out(static_cast<long>(fpid), header, std::string_view{it->data});
+          pending.erase(it);
+        }
+        continue;
+      }
+      std::size_t e = t.find('\n', p);
+      e = e == std::string_view::npos ? t.size() : e + 1;
+      out(static_cast<long>(pid), header, t.substr(p, e - p));
+      p = e;
+    }
+  }
+};
+#endif
+
+// thread-safe localtime, only recomputed when the second changes
+inline std::tm local_tm(std::time_t t) {
+  thread_local std::time_t last = -1;
+  thread_local std::tm cached{};
+  if (t != last) {
+#ifdef _WIN32
+    ::localtime_s(&cached, &t);
+#else
+    ::localtime_r(&t, &cached);
+#endif
+    last = t;
+  }
+  return cached;
+}
+
+// Single background thread for slow file maintenance (renames, reopening,
+// preallocation), so that it never happens on the logging path.
+// Thread is started on first task.
+class BackgroundTasks {
+ public:
+  BackgroundTasks() = default;
+  BackgroundTasks(const BackgroundTasks&) = delete;
+  BackgroundTasks& operator=(const BackgroundTasks&) = delete;
+  ~BackgroundTasks() { stop(); }
+
+  void post(std::function<void()> task) {
+    std::lock_guard<std::mutex> lock{mtx};
+    tasks.push_back(std::move(task));
+    if (!worker.joinable()) worker = std::thread{[this]() { run(); }};
+    cv.notify_one();
+  }
+
+  // waits until posted tasks are done (must not be called from a task)
+  void wait() {
+    std::unique_lock<std::mutex> lock{mtx};
+    done_cv.wait(lock, [this]() { return tasks.empty() && !busy; });
+  }
+
+  // runs remaining tasks and stops thread
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock{mtx};
+      quit = true;
+    }
+    cv.notify_one();
+    if (worker.joinable()) worker.join();
+    quit = false;
+  }
+
+ private:
+  void run() {
+    std::unique_lock<std::mutex> lock{mtx};
+    for (;;) {
+      cv.wait(lock, [this]() { return quit || !tasks.empty(); });
+      if (tasks.empty()) return;
+      auto task = std::move(tasks.front());
+      tasks.pop_front();
+      busy = true;
+      lock.unlock();
+      task();
+      lock.lock();
+      busy = false;
+      if (tasks.empty()) done_cv.notify_all();
+    }
+  }
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::condition_variable done_cv;
+  std::deque<std::function<void()>> tasks;
+  bool busy{false};
+  bool quit{false};
+  std::thread worker;
+};
+
+inline BackgroundTasks file_tasks;
+
+// Background thread flushing sinks added to it, each one every
+// flush_policy.interval (read on add). Thread is started on first add.
+// A sink must be removed before it is destroyed.
+MODLOG_MOD_EXPORT class FlushTimer {
+ public:
+  FlushTimer() = default;
+  FlushTimer(const FlushTimer&) = delete;
+  FlushTimer& operator=(const FlushTimer&) = delete;
+  ~FlushTimer() { stop(); }
+
+  void add(LogSink* sink) {
+    auto every = sink->flush_policy.interval;
+    if (every.count() <= 0) return;
+    std::lock_guard<std::mutex> lock{mtx};
+    for (auto& e : entries)
+      if (e.sink == sink) e.interval = every;
+    if (std::none_of(entries.begin(), entries.end(),
+                     [sink](const Entry& e) { return e.sink == sink; }))
+      entries.push_back(
+          Entry{sink, every, std::chrono::steady_clock::now() + every});
+    if (!worker.joinable()) worker = std::thread{[this]() { run(); }};
+    cv.notify_one();
+  }
+
+  // (after it returns, sink is not being flushed by timer)
+  void remove(LogSink* sink) {
+    std::lock_guard<std::mutex> lock{mtx};
+    entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                 [sink](const Entry& e) {
+                                   return e.sink == sink;
+                                 }),
+                  entries.end());
+  }
+
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock{mtx};
+      quit = true;
+    }
+    cv.notify_one();
+    if (worker.joinable()) worker.join();
+    quit = false;
+  }
+
+ private:
+  struct Entry {
+    LogSink* sink;
+    std::chrono::milliseconds interval;
+    std::chrono::steady_clock::time_point next;
+  };
+
+  void run() {
+    std::unique_lock<std::mutex> lock{mtx};
+    while (!quit) {
+      auto now = std::chrono::steady_clock::now();
+      auto wake = now + std::chrono::seconds{1};
+      // flushes under lock, so that remove() waits for it
+      for (auto& e : entries) {
+        if (e.next <= now) {
+          e.sink->flush();
+          e.next = now + e.interval;
+        }
+        wake = std::min(wake, e.next);
+      }
+      cv.wait_until(lock, wake);
+    }
+  }
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::vector<Entry> entries;
+  bool quit{false};
+  std::thread worker;
+};
+
+MODLOG_MOD_EXPORT inline FlushTimer flush_timer;
+
+// time-based rotation of a FileSink (periods start on local time)
+MODLOG_MOD_EXPORT enum class Rotation : int { Off, Hourly, Daily };
+
+// start of period containing 't'
+inline std::time_t period_start(std::time_t t, Rotation r) {
+  std::tm tm = local_tm(t);
+  tm.tm_min = 0;
+  tm.tm_sec = 0;
+  if (r == Rotation::Daily) tm.tm_hour = 0;
+  tm.tm_isdst = -1;
+  return std::mktime(&tm);
+}
+
+// start of period after the one containing 't'
+inline std::time_t period_end(std::time_t t, Rotation r) {
+  std::time_t start = period_start(t, r);
+  if (r == Rotation::Hourly) return start + 3600;
+  std::tm tm = local_tm(start);
+  tm.tm_mday++;
+  tm.tm_isdst = -1;
+  return std::mktime(&tm);
+}
+
+// glog-style file time: yyyymmdd-hhmmss
+inline std::string file_stamp(std::time_t t) {
+  auto now_tm = local_tm(t);
+  char stime[16];
+  char* p = stime;
+  p = put_digits(p, now_tm.tm_year + 1900, 4);
+  p = put_digits(p, now_tm.tm_mon + 1, 2);
+  p = put_digits(p, now_tm.tm_mday, 2);
+  *p++ = '-';
+  p = put_digits(p, now_tm.tm_hour, 2);
+  p = put_digits(p, now_tm.tm_min, 2);
+  p = put_digits(p, now_tm.tm_sec, 2);
+  return std::string(stime, p);
+}
+
+// =======================================
+//   LZ4 frame compression (for files)
+// =======================================
+
+// xxHash32 (used by LZ4 frame headers)
+inline std::uint32_t xxh32(const void* data, std::size_t n,
+                           std::uint32_t seed = 0) {
+  constexpr std::uint32_t p1 = 2654435761U, p2 = 2246822519U,
+                          p3 = 3266489917U, p4 = 668265263U, p5 = 374761393U;
+  auto rotl = [](std::uint32_t x, int r) { return (x << r) | (x >> (32 - r)); };
+  auto read32 = [](const unsigned char* p) {
+    return std::uint32_t(p[0]) | std::uint32_t(p[1]) << 8 |
+           std::uint32_t(p[2]) << 16 | std::uint32_t(p[3]) << 24;
+  };
+  const auto* p = static_cast<const unsigned char*>(data);
+  const auto* end = p + n;
+  std::uint32_t h;
+  if (n >= 16) {
+    std::uint32_t v[4] = {seed + p1 + p2, seed + p2, seed, seed - p1};
+    for (; p + 16 <= end; p += 16)
+      for (int i = 0; i < 4; i++)
+        v[i] = rotl(v[i] + read32(p + 4 * i) * p2, 13) * p1;
+    h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+  } else {
+    h = seed + p5;
+  }
+  h += static_cast<std::uint32_t>(n);
+  for (; p + 4 <= end; p += 4) h = rotl(h + read32(p) * p3, 17) * p4;
+  for (; p < end; p++) h = rotl(h + (*p) * p5, 11) * p1;
+  h ^= h >> 15;
+  h *= p2;
+  h ^= h >> 13;
+  h *= p3;
+  h ^= h >> 16;
+  return h;
+}
+
+// Writes standard LZ4 frames (independent blocks, no checksums), readable
+// by 'lz4 -d' and lz4_decompress()
+class Lz4Encoder {
+ public:
+  static constexpr std::uint32_t magic = 0x184D2204;
+
+  // largest block for blocks up to 'n' bytes (64KiB, 256KiB, 1MiB or 4MiB)
+  void set_block_size(std::size_t n) {
+    bd = 4;
+    while (bd < 7 && n > (std::size_t{1} << (6 + 2 * bd))) bd++;
+  }
+
+  std::size_t block_size() const { return std::size_t{1} << (6 + 2 * bd); }
+
+  void header(std::string& out) const {
+    unsigned char h[7];
+    put32(h, magic);
+    h[4] = 0x60;  // version 01, independent blocks
+    h[5] = static_cast<unsigned char>(bd << 4);
+    h[6] = static_cast<unsigned char>((xxh32(h + 4, 2) >> 8) & 0xff);
+    out.append(reinterpret_cast<char*>(h), sizeof(h));
+  }
+
+  static void end_mark(std::string& out) { out.append(4, '\0'); }
+
+  // appends 'data' as blocks (compressed, unless it does not pay off)
+  void blocks(std::string& out, const char* data, std::size_t n) {
+    while (n > 0) {
+      std::size_t k = std::min(n, block_size());
+      std::size_t at = out.size();
+      out.resize(at + 4 + k + k / 255 + 16);
+      auto* dst = reinterpret_cast<unsigned char*>(&out[at + 4]);
+      std::size_t c = compress(reinterpret_cast<const unsigned char*>(data),
+                               k, dst);
+      if (c >= k) {
+        std::memcpy(dst, data, k);
+        put32(reinterpret_cast<unsigned char*>(&out[at]),
+              static_cast<std::uint32_t>(k) | 0x80000000U);
+        c = k;
+      } else {
+        put32(reinterpret_cast<unsigned char*>(&out[at]),
+              static_cast<std::uint32_t>(c));
+      }
+      out.resize(at + 4 + c);
+      data += k;
+      n -= k;
+    }
+  }
+
+  // block as is (async-signal-safe, on caller buffer of n + 4 bytes)
+  static void raw_block_header(unsigned char* h, std::size_t n) {
+    put32(h, static_cast<std::uint32_t>(n) | 0x80000000U);
+  }
+
+ private:
+  static void put32(unsigned char* p, std::uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = static_cast<unsigned char>(v >> 8 * i);
+  }
+
+  static std::uint32_t read32(const unsigned char* p) {
+    std::uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+  }
+
+  static unsigned char* put_length(unsigned char* op, std::size_t len) {
+    for (; len >= 255; len -= 255) *op++ = 255;
+    *op++ = static_cast<unsigned char>(len);
+    return op;
+  }
+
+  // greedy LZ4 block compression, returning compressed size
+  std::size_t compress(const unsigned char* src, std::size_t n,
+                       unsigned char* dst) {
+    constexpr int hash_bits = 14;
+    if (table.empty()) table.resize(std::size_t{1} << hash_bits);
+    std::fill(table.begin(), table.end(), 0);
+    const unsigned char* ip = src;
+    const unsigned char* anchor = src;
+    const unsigned char* end = src + n;
+    unsigned char* op = dst;
+    if (n >= 13) {
+      const unsigned char* mflimit = end - 12;
+      const unsigned char* matchlimit = end - 5;
+      while (ip < mflimit) {
+        std::uint32_t seq = read32(ip);
+        std::uint32_t h = (seq * 2654435761U) >> (32 - hash_bits);
+        std::uint32_t ref_pos = table[h];
+        table[h] = static_cast<std::uint32_t>(ip - src) + 1;
+        // (ref_pos 0 is an empty slot, checked before forming a pointer)
+        if (ref_pos == 0 || (ip - src) - (ref_pos - 1) > 65535 ||
+            read32(src + ref_pos - 1) != seq) {
+          ip += 1 + ((ip - anchor) >> 6);
+          continue;
+        }
+        const unsigned char* ref = src + ref_pos - 1;
+        const unsigned char* m = ip + 4;
+        const unsigned char* r = ref + 4;
+        while (m < matchlimit && *m == *r) {
+          m++;
+          r++;
+        }
+        std::size_t lit = static_cast<std::size_t>(ip - anchor);
+        std::size_t mlen = static_cast<std::size_t>(m - ip) - 4;
+        unsigned char* token = op++;
+        *token = static_cast<unsigned char>(
+            (std::min<std::size_t>(lit, 15) << 4) |
+            std::min<std::size_t>(mlen, 15));
+        if (lit >= 15) op = put_length(op, lit - 15);
+        std::memcpy(op, anchor, lit);
+        op += lit;
+        auto off = static_cast<std::uint32_t>(ip - ref);
+        *op++ = static_cast<unsigned char>(off);
+        *op++ = static_cast<unsigned char>(off >> 8);
+        if (mlen >= 15) op = put_length(op, mlen - 15);
+        ip = anchor = m;
+      }
+    }
+    std::size_t lit = static_cast<std::size_t>(end - anchor);
+    *op++ = static_cast<unsigned char>(std::min<std::size_t>(lit, 15) << 4);
+    if (lit >= 15) op = put_length(op, lit - 15);
+    std::memcpy(op, anchor, lit);
+    op += lit;
+    return static_cast<std::size_t>(op - dst);
+  }
+
+  int bd{4};
+  std::vector<std::uint32_t> table;
+};
+
+// appends decompressed contents of (concatenated) LZ4 frames in 'in';
+// false when data is not a valid LZ4 frame (a truncated frame is decoded up
+// to its last complete block)
+MODLOG_MOD_EXPORT inline bool lz4_decompress(std::string_view in,
+                                             std::string& out) {
+  const auto* p = reinterpret_cast<const unsigned char*>(in.data());
+  const auto* end = p + in.size();
+  auto read32 = [](const unsigned char* q) {
+    return std::uint32_t(q[0]) | std::uint32_t(q[1]) << 8 |
+           std::uint32_t(q[2]) << 16 | std::uint32_t(q[3]) << 24;
+  };
+  bool any = false;
+  while (end - p >= 4) {
+    std::uint32_t m = read32(p);
+    if ((m & 0xFFFFFFF0U) == 0x184D2A50U) {  // skippable frame
+      if (end - p < 8) return any;
+      std::size_t n = read32(p + 4);
+      if (static_cast<std::size_t>(end - p - 8) < n) return any;
+      p += 8 + n;
+      continue;
+    }
+    if (m != Lz4Encoder::magic || end - p < 7) return any;
+    unsigned flg = p[4];
+    if ((flg >> 6) != 1) return false;
+    std::size_t hlen = 7 + ((flg & 0x08) ? 8 : 0) + ((flg & 0x01) ? 4 : 0);
+    if (static_cast<std::size_t>(end - p) < hlen) return any;
+    bool block_sum = flg & 0x10;
+    bool content_sum = flg & 0x04;
+    p += hlen;
+    any = true;
+    for (;;) {
+      if (end - p < 4) return true;
+      std::uint32_t bs = read32(p);
+      p += 4;
+      if (bs == 0) break;
+      bool raw = bs & 0x80000000U;
+      std::size_t n = bs & 0x7FFFFFFFU;
+      if (static_cast<std::size_t>(end - p) < n + (block_sum ? 4 : 0))
+        return true;
+      if (raw) {
+        out.append(reinterpret_cast<const char*>(p), n);
+      } else {
+        const unsigned char* ip = p;
+        const unsigned char* iend = p + n;
+        while (ip < iend) {
+          unsigned token = *ip++;
+          std::size_t lit = token >> 4;
+          if (lit == 15) {
+            unsigned char b;
+            do {
+              if (ip >= iend) return false;
+              b = *ip++;
+              lit += b;
+            } while (b == 255);
+          }
+          if (static_cast<std::size_t>(iend - ip) < lit) return false;
+          out.append(reinterpret_cast<const char*>(ip), lit);
+          ip += lit;
+          if (ip >= iend) break;  // last literals
+          if (iend - ip < 2) return false;
+          std::size_t off = ip[0] | (std::size_t(ip[1]) << 8);
+          ip += 2;
+          std::size_t mlen = (token & 15);
+          if (mlen == 15) {
+            unsigned char b;
+            do {
+              if (ip >= iend) return false;
+              b = *ip++;
+              mlen += b;
+            } while (b == 255);
+          }
+          mlen += 4;
+          if (off == 0 || off > out.size()) return false;
+          std::size_t from = out.size() - off;
+          for (std::size_t i = 0; i < mlen; i++) out.push_back(out[from + i]);
+        }
+      }
+      p += n + (block_sum ? 4 : 0);
+    }
+    if (content_sum) p += 4;
+  }
+  return any;
+}
+
+// contents of a log file, decompressed when it is LZ4 (empty on failure)
+MODLOG_MOD_EXPORT inline std::string read_log_file(const std::string& path) {
+  std::ifstream f{path, std::ios::binary};
+  std::string data{std::istreambuf_iterator<char>{f}, {}};
+  if (data.size() >= 4 && static_cast<unsigned char>(data[0]) == 0x04 &&
+      static_cast<unsigned char>(data[1]) == 0x22 &&
+      static_cast<unsigned char>(data[2]) == 0x4D &&
+      static_cast<unsigned char>(data[3]) == 0x18) {
+    std::string out;
+    lz4_decompress(data, out);
+    return out;
+  }
+  return data;
+}
+
+// Single log file with a large user-space buffer, written with write(2):
+// - when the buffer is full (size threshold)
+// - when a record has level >= flush_policy.level (Warning by default)
+// - every flush_policy.interval (30s by default, from flush_timer)
+// When max_size > 0, file is rotated before reaching max_size bytes:
+// <path> becomes <path>.1, <path>.1 becomes <path>.2 ... up to max_files
+// files. Next file is opened (and preallocated) in background as
+// <path>.next, so a rotation on the logging path is only a swap of fds.
+// With time rotation, file is <path>.<yyyymmdd-hhmmss><suffix>, named after
+// start of current hour or day, and file of next period is also opened in
+// background. Files <path>.* older than max_age are removed in background.
+// With 'compress', each file is an LZ4 frame (read it with 'lz4 -d' or
+// read_log_file()): every buffer is compressed as one block when written,
+// so it runs on the backend thread with asynchronous logging. A crash only
+// loses the records not written yet (blocks are independent). In this
+// mode, max_size counts uncompressed bytes.
+MODLOG_MOD_EXPORT class FileSink : public LogSink {
+ public:
+  std::size_t buffer_size{256 * 1024};
+  // rotation and retention (set before open)
+  std::size_t max_size{0};
+  int max_files{5};
+  bool preallocate{true};
+  Rotation rotation{Rotation::Off};
+  std::chrono::seconds max_age{0};
+  // symlink to current file (when not empty)
+  std::string link;
+  // LZ4 frame compression (set before open)
+  bool compress{false};
+
+  FileSink() {
+    flush_policy = {LogLevel::Warning, 0, std::chrono::seconds{30}};
+  }
+  FileSink(const FileSink&) = delete;
+  FileSink& operator=(const FileSink&) = delete;
+  ~FileSink() override { close(); }
+
+  bool open(const std::string& path, std::string_view suffix = {}) {
+    FileSink::close();
+    std::unique_lock<std::mutex> lock{mtx};
+    fpath = path;
+    fsuffix = suffix;
+    cur_path = fpath + fsuffix;
+    next_boundary = std::numeric_limits<std::int64_t>::max();
+    if (rotation != Rotation::Off) {
+      auto now = std::time(nullptr);
+      cur_path = period_path(period_start(now, rotation));
+      next_boundary = period_end(now, rotation);
+    }
+    int f = file_open_append(cur_path);
+    if (f < 0) return false;
+    capacity = buffer_size;
+    buf.reset(new char[capacity]);
+    used = 0;
+    lz4_on = compress;
+    if (lz4_on) {
+      lz4.set_block_size(capacity);
+      start_frame(f);
+    }
+    remaining = static_cast<std::size_t>(-1);
+    if (max_size > 0) {
+      remaining = max_size - std::min(file_size(f), max_size);
+      if (preallocate) file_preallocate(f, remaining);
+      file_tasks.post([this]() { open_next(); });
+    }
+    if (rotation != Rotation::Off)
+      file_tasks.post([this, b = next_boundary]() { open_period(b); });
+    if (max_age.count() > 0) file_tasks.post([this]() { remove_expired(); });
+    update_link(cur_path);
+    fd.store(f, std::memory_order_release);
+    lock.unlock();
+    flush_timer.add(this);
+    return true;
+  }
+
+  bool is_open() const { return fd.load(std::memory_order_acquire) >= 0; }
+
+  // current file
+  std::string path() {
+    std::lock_guard<std::mutex> lock{mtx};
+    return cur_path;
+  }
+
+  void write(LogLevel l, std::string_view record) override {
+    write_at(l, record, std::chrono::system_clock::now());
+  }
+
+  void write_at(LogLevel, std::string_view record,
+                std::chrono::system_clock::time_point time) override {
+    std::lock_guard<std::mutex> lock{mtx};
+    // (closed: no rotation, which would post tasks for this sink)
+    if (fd.load(std::memory_order_relaxed) < 0) return;
+    if (rotation != Rotation::Off) {
+      using namespace std::chrono;  // NOLINT
+      auto secs = duration_cast<seconds>(time.time_since_epoch()).count();
+      if (secs >= next_boundary) rotate_period_locked(secs);
+    }
+    if (record.size() > remaining) rotate_locked(record.size());
+    remaining -= record.size();
+    int f = fd.load(std::memory_order_relaxed);
+    if (f < 0) return;
+    if (record.size() > capacity - used) {
+      flush_locked();
+      // too large for buffer: bypass it
+      if (record.size() > capacity) {
+        write_locked(f, record.data(), record.size());
+        return;
+      }
+    }
+    std::memcpy(buf.get() + used, record.data(), record.size());
+    used += record.size();
+  }
+
+  void flush() override {
+    std::lock_guard<std::mutex> lock{mtx};
+    flush_locked();
+  }
+
+  void close() override {
+    flush_timer.remove(this);
+    {
+      std::lock_guard<std::mutex> lock{mtx};
+      close_locked();
+    }
+    // tasks posted before closing may still open files ahead
+    file_tasks.wait();
+    std::lock_guard<std::mutex> lock{mtx};
+    release_ahead_locked();
+  }
+
+  void crash_write(std::string_view record) override {
+    int f = fd.load(std::memory_order_relaxed);
+    if (f < 0) return;
+    if (!lz4_on) {
+      if (buf && used > 0 && used <= capacity)
+        file_write_all(f, buf.get(), used);
+      used = 0;
+      file_write_all(f, record.data(), record.size());
+      return;
+    }
+    // uncompressed blocks and end of frame (no allocation)
+    unsigned char h[4];
+    if (buf && used > 0 && used <= capacity) {
+      Lz4Encoder::raw_block_header(h, used);
+      file_write_all(f, reinterpret_cast<char*>(h), 4);
+      file_write_all(f, buf.get(), used);
+    }
+    used = 0;
+    if (!record.empty()) {
+      Lz4Encoder::raw_block_header(h, record.size());
+      file_write_all(f, reinterpret_cast<char*>(h), 4);
+      file_write_all(f, record.data(), record.size());
+    }
+    std::memset(h, 0, 4);
+    file_write_all(f, reinterpret_cast<char*>(h), 4);
+  }
+
+ private:
+  std::string period_path(std::int64_t start) const {
+    return fpath + "." + file_stamp(static_cast<std::time_t>(start)) +
+           fsuffix;
+  }
+
+  static std::string rotated_path(const std::string& path, int i) {
+    return i == 0 ? path : path + "." + std::to_string(i);
+  }
+
+  // switches to next file, when it is ready (otherwise, keeps current file
+  // for at least 'n' bytes, and retries on next write)
+  void rotate_locked(std::size_t n) {
+    if (max_size == 0 || next_fd < 0) {
+      remaining = max_size == 0 ? static_cast<std::size_t>(-1) : n;
+      return;
+    }
+    flush_locked();
+    end_frame(fd.load(std::memory_order_relaxed));
+    int old = fd.exchange(next_fd, std::memory_order_acq_rel);
+    next_fd = -1;
+    start_frame(fd.load(std::memory_order_relaxed));
+    remaining = std::max(max_size, n);
+    file_tasks.post([this, old, cur = cur_path]() {
+      file_trim(old);
+      file_close(old);
+      std::error_code ec;
+      for (int i = max_files - 1; i > 0; i--)
+        std::filesystem::rename(rotated_path(cur, i - 1),
+                                rotated_path(cur, i), ec);
+      if (max_files <= 1) std::filesystem::remove(cur, ec);
+      std::filesystem::rename(fpath + ".next", cur, ec);
+      open_next();
+      remove_expired();
+    });
+  }
+
+  // switches to file of period containing 'now' (seconds since epoch):
+  // the one opened ahead, or, after an idle period or when it is not ready,
+  // one opened here (when it cannot be opened, retries on next write)
+  void rotate_period_locked(std::int64_t now) {
+    auto t = static_cast<std::time_t>(now);
+    std::int64_t start = period_start(t, rotation);
+    int f = -1;
+    std::string p;
+    if (period_fd >= 0 && start == next_boundary) {
+      f = std::exchange(period_fd, -1);
+      p = std::move(period_file);
+    } else {
+      p = period_path(start);
+      f = file_open_append(p);
+      if (f < 0) return;
+      if (preallocate && max_size > 0) file_preallocate(f, max_size);
+      if (period_fd >= 0) {
+        // opened ahead for a period that had no records
+        bool empty = file_size(period_fd) == 0;
+        file_close(std::exchange(period_fd, -1));
+        std::error_code ec;
+        if (empty) std::filesystem::remove(period_file, ec);
+      }
+    }
+    period_file.clear();
+    flush_locked();
+    end_frame(fd.load(std::memory_order_relaxed));
+    int old = fd.exchange(f, std::memory_order_acq_rel);
+    start_frame(f);
+    cur_path = std::move(p);
+    next_boundary = period_end(t, rotation);
+    if (max_size > 0)
+      remaining = max_size - std::min(file_size(fd.load()), max_size);
+    file_tasks.post([this, old, cur = cur_path, b = next_boundary]() {
+      file_trim(old);
+      file_close(old);
+      update_link(cur);
+      open_period(b);
+      remove_expired();
+    });
+  }
+
+  // (background) creates <path>.next for next size rotation
+  void open_next() {
+    std::string next = fpath + ".next";
+    std::error_code ec;
+    std::filesystem::remove(next, ec);
+    int f = file_open_append(next);
+    if (f < 0) return;
+    if (preallocate) file_preallocate(f, max_size);
+    std::lock_guard<std::mutex> lock{mtx};
+    next_fd = f;
+  }
+
+  // (background) opens file of period starting at 'start', unless writes
+  // have already moved past it
+  void open_period(std::int64_t start) {
+    std::string p = period_path(start);
+    int f = file_open_append(p);
+    if (f < 0) return;
+    if (preallocate && max_size > 0) file_preallocate(f, max_size);
+    std::lock_guard<std::mutex> lock{mtx};
+    if (start != next_boundary || period_fd >= 0) {
+      bool empty = file_size(f) == 0;
+      file_close(f);
+      std::error_code ec;
+      if (empty && p != cur_path) std::filesystem::remove(p, ec);
+      return;
+    }
+    period_fd = f;
+    period_file = std::move(p);
+  }
+
+  // (background) removes files <path>.* older than max_age
+  void remove_expired() {
+    if (max_age.count() <= 0) return;
+    namespace fs = std::filesystem;  // NOLINT
+    fs::path base{fpath};
+    fs::path dir = base.parent_path();
+    if (dir.empty()) dir = ".";
+    std::string prefix = base.filename().string() + ".";
+    std::vector<std::string> keep{prefix + "next"};
+    {
+      std::lock_guard<std::mutex> lock{mtx};
+      keep.push_back(fs::path{cur_path}.filename().string());
+      keep.push_back(fs::path{period_file}.filename().string());
+    }
+    auto limit = fs::file_time_type::clock::now() - max_age;
+    std::error_code ec;
+    for (fs::directory_iterator it{dir, ec}, end; !ec && it != end;
+         it.increment(ec)) {
+      std::string name = it->path().filename().string();
+      if (name.rfind(prefix, 0) != 0) continue;
+      if (std::find(keep.begin(), keep.end(), name) != keep.end()) continue;
+      std::error_code ec2;
+      auto t = fs::last_write_time(it->path(), ec2);
+      if (!ec2 && t < limit) fs::remove(it->path(), ec2);
+    }
+  }
+
+  // (background or open) points 'link' to 'target'
+  void update_link([[maybe_unused]] const std::string& target) {
+#ifndef _WIN32
+    if (link.empty()) return;
+    auto slash = target.find_last_of('/');
+    const char* name =
+        target.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+    ::unlink(link.c_str());
+    [[maybe_unused]] int r = ::symlink(name, link.c_str());
+#endif
+  }
+
+  void flush_locked() {
+    int f = fd.load(std::memory_order_relaxed);
+    if (f >= 0 && used > 0) write_locked(f, buf.get(), used);
+    used = 0;
+  }
+
+  void write_locked(int f, const char* data, std::size_t n) {
+    if (!lz4_on) {
+      file_write_all(f, data, n);
+      return;
+    }
+    zbuf.clear();
+    lz4.blocks(zbuf, data, n);
+    file_write_all(f, zbuf.data(), zbuf.size());
+  }
+
+  // (compress) frame header of a new file, or of a frame appended to it
+  void start_frame(int f) {
+    if (!lz4_on || f < 0) return;
+    zbuf.clear();
+    lz4.header(zbuf);
+    file_write_all(f, zbuf.data(), zbuf.size());
+  }
+
+  void end_frame(int f) {
+    if (!lz4_on || f < 0) return;
+    zbuf.clear();
+    Lz4Encoder::end_mark(zbuf);
+    file_write_all(f, zbuf.data(), zbuf.size());
+  }
+
+  void close_locked() {
+    int f = fd.load(std::memory_order_relaxed);
+    if (f < 0) return;
+    flush_locked();
+    end_frame(f);
+    release_ahead_locked();
+    file_trim(f);
+    file_close(f);
+    fd.store(-1, std::memory_order_release);
+    buf.reset();
+    capacity = 0;
+  }
+
+  // closes files opened ahead (removing them, when still empty)
+  void release_ahead_locked() {
+    std::error_code ec;
+    if (next_fd >= 0) {
+      file_close(next_fd);
+      next_fd = -1;
+      std::filesystem::remove(fpath + ".next", ec);
+    }
+    if (period_fd >= 0) {
+      // created ahead of its period: removed if still empty
+      bool empty = file_size(period_fd) == 0;
+      file_close(period_fd);
+      period_fd = -1;
+      if (empty) std::filesystem::remove(period_file, ec);
+      period_file.clear();
+    }
+  }
+
+  std::mutex mtx;
+  std::atomic<int> fd{-1};
+  std::string fpath;
+  std::string fsuffix;
+  std::string cur_path;
+  std::unique_ptr<char[]> buf;
+  std::size_t capacity{0};
+  std::size_t used{0};
+  // bytes before next size rotation
+  std::size_t remaining{static_cast<std::size_t>(-1)};
+  int next_fd{-1};
+  // time (seconds since epoch) of next time rotation
+  std::int64_t next_boundary{std::numeric_limits<std::int64_t>::max()};
+  int period_fd{-1};
+  std::string period_file;
+  bool lz4_on{false};
+  Lz4Encoder lz4;
+  std::string zbuf;
+};
+
+#ifndef _WIN32
+// Appends records to a shared memory mapping of the log file, with a memcpy
+// and no syscall per record. Mapping is a window of 'chunk' bytes (file is
+// extended with it), remapped further when full, and file is truncated to
+// its real length on close. Records already copied are in page cache, so
+// they survive a crash of the process. While open, file has trailing zeros
+// (left by a crash, they are trimmed when the file is opened again, so
+// records must not end with a zero byte).
+MODLOG_MOD_EXPORT class MmapFileSink : public LogSink {
+ public:
+  std::size_t chunk{16 * 1024 * 1024};
+
+  MmapFileSink() = default;
+  MmapFileSink(const MmapFileSink&) = delete;
+  MmapFileSink& operator=(const MmapFileSink&) = delete;
+  ~MmapFileSink() override { close(); }
+
+  bool open(const std::string& path) {
+    std::lock_guard<std::mutex> lock{mtx};
+    close_locked();
+    int f = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0664);
+    if (f < 0) return false;
+    fd = f;
+    len = data_length(f, file_size(f));
+    if (!map_locked(0)) {
+      ::close(f);
+      fd = -1;
+      return false;
+    }
+    return true;
+  }
+
+  bool is_open() const { return fd >= 0; }
+
+  // bytes written to file
+  std::size_t size() {
+    std::lock_guard<std::mutex> lock{mtx};
+    return len;
+  }
+
+  void write(LogLevel, std::string_view record) override {
+    std::lock_guard<std::mutex> lock{mtx};
+    if (fd < 0) return;
+    if (len + record.size() > map_off + map_len && !map_locked(record.size()))
+      return;
+    std::memcpy(base + (len - map_off), record.data(), record.size());
+    len += record.size();
+  }
+
+  // schedules write-back of mapping (does not wait for it)
+  void flush() override {
+    std::lock_guard<std::mutex> lock{mtx};
+    if (base) ::msync(base, map_len, MS_ASYNC);
+  }
+
+  void close() override {
+    std::lock_guard<std::mutex> lock{mtx};
+    close_locked();
+  }
+
+  void crash_write(std::string_view record) override {
+    if (fd < 0 || !base || len + record.size() > map_off + map_len) return;
+    std::memcpy(base + (len - map_off), record.data(), record.size());
+    len += record.size();
+  }
+
+ private:
+  // length of file without trailing zeros (of a mapping not truncated)
+  static std::size_t data_length(int f, std::size_t size) {
+    char block[4096];
+    while (size > 0) {
+      std::size_t n = std::min(size, sizeof(block));
+      if (::pread(f, block, n, static_cast<off_t>(size - n)) !=
+          static_cast<ssize_t>(n))
+        return size;
+      while (n > 0 && block[n - 1] == 0) {
+        n--;
+        size--;
+      }
+      if (n > 0) break;
+    }
+    return size;
+  }
+
+  // maps a window from page of 'len', with room for 'n' more bytes
+  bool map_locked(std::size_t n) {
+    auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    auto round = [page](std::size_t v) { return (v + page - 1) / page * page; };
+    std::size_t off = len / page * page;
+    std::size_t size = std::max(round(chunk), round(len - off + n));
+#ifdef __linux__
+    if (::posix_fallocate(fd, static_cast<off_t>(off),
+                          static_cast<off_t>(size)) != 0)
+#endif
+      if (::ftruncate(fd, static_cast<off_t>(off + size)) != 0) return false;
+    void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                     static_cast<off_t>(off));
+    if (p == MAP_FAILED) return false;
+    unmap_locked();
+    base = static_cast<char*>(p);
+    map_off = off;
+    map_len = size;
+    return true;
+  }
+
+  void unmap_locked() {
+    if (!base) return;
+    ::msync(base, map_len, MS_ASYNC);
+    ::munmap(base, map_len);
+    base = nullptr;
+    map_len = 0;
+  }
+
+  void close_locked() {
+    if (fd < 0) return;
+    unmap_locked();
+    [[maybe_unused]] int r = ::ftruncate(fd, static_cast<off_t>(len));
+    ::close(fd);
+    fd = -1;
+  }
+
+  std::mutex mtx;
+  int fd{-1};
+  char* base{nullptr};
+  std::size_t map_off{0};
+  std::size_t map_len{0};
+  std::size_t len{0};
+};
+#endif
+
+#ifdef MODLOG_HAS_IO_URING
+// Linux sink with records copied into 'buffers' fixed buffers, written with
+// io_uring (WRITE_FIXED on registered file and buffers) when a buffer is
+// full, or on flush() (as at flush_policy.level, Warning by default, which
+// also waits for pending writes). Writes overlap with formatting of next
+// records; with 'sqpoll', a kernel thread picks submissions, so there is no
+// syscall per write (it costs a polling thread, so it is off by default).
+// When io_uring is unavailable (or use_uring is false), full buffers are
+// written together with a single pwritev(2).
+MODLOG_MOD_EXPORT class UringFileSink : public LogSink {
+ public:
+  std::size_t buffer_size{256 * 1024};
+  int buffers{4};
+  bool use_uring{true};
+  bool sqpoll{false};
+
+  UringFileSink() { flush_policy.level = LogLevel::Warning; }
+  UringFileSink(const UringFileSink&) = delete;
+  UringFileSink& operator=(const UringFileSink&) = delete;
+  ~UringFileSink() override { close(); }
+
+  bool open(const std::string& path) {
+    std::unique_lock<std::mutex> lock{mtx};
+    close_locked();
+    int f = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0664);
+    if (f < 0) return false;
+    fd = f;
+    offset = file_size(f);
+    bufs.clear();
+    for (int i = 0; i < std::max(buffers, 2); i++)
+      bufs.push_back(Buffer{std::unique_ptr<char[]>{new char[buffer_size]}});
+    cur = 0;
+    if (use_uring) setup_ring();
+    lock.unlock();
+    flush_timer.add(this);
+    return true;
+  }
+
+  bool is_open() const { return fd >= 0; }
+
+  // true when writes go through io_uring
+  bool uring_active() const { return ring_fd >= 0; }
+
+  void write(LogLevel, std::string_view record) override {
+    std::lock_guard<std::mutex> lock{mtx};
+    if (fd < 0) return;
+    if (record.size() > buffer_size - bufs[cur].used) {
+      submit_locked();
+      if (record.size() > buffer_size) {
+        // too large for buffers: written directly
+        drain_locked();
+        write_at(record.data(), record.size(), offset);
+        offset += record.size();
+        return;
+      }
+    }
+    Buffer& b = bufs[cur];
+    std::memcpy(b.data.get() + b.used, record.data(), record.size());
+    b.used += record.size();
+  }
+
+  // writes pending buffers and waits for them
+  void flush() override {
+    std::lock_guard<std::mutex> lock{mtx};
+    if (fd < 0) return;
+    submit_locked();
+    drain_locked();
+  }
+
+  void close() override {
+    flush_timer.remove(this);
+    std::lock_guard<std::mutex> lock{mtx};
+    close_locked();
+  }
+
+  void crash_write(std::string_view record) override {
+    if (fd < 0 || bufs.empty()) return;
+    Buffer& b = bufs[cur];
+    if (!b.busy && b.used > 0) {
+      write_at(b.data.get(), b.used, offset);
+      offset += b.used;
+      b.used = 0;
+    }
+    write_at(record.data(), record.size(), offset);
+    offset += record.size();
+  }
+
+ private:
+  struct Buffer {
+    std::unique_ptr<char[]> data;
+    std::size_t used{0};
+    bool busy{false};  // submitted (or waiting for pwritev)
+    std::size_t off{0};
+  };
+
+  void write_at(const char* p, std::size_t n, std::size_t off) {
+    while (n > 0) {
+      auto r = ::pwrite(fd, p, n, static_cast<off_t>(off));
+      if (r < 0) {
+        if (errno == EINTR) continue;
+        return;
+      }
+      p += r;
+      n -= static_cast<std::size_t>(r);
+      off += static_cast<std::size_t>(r);
+    }
+  }
+
+  // hands current buffer to kernel (or queues it for pwritev), and moves
+  // to next free buffer
+  void submit_locked() {
+    Buffer& b = bufs[cur];
+    if (b.used == 0) return;
+    b.busy = true;
+    b.off = offset;
+    offset += b.used;
+    if (ring_fd >= 0) push_sqe(cur);
+    std::size_t next = (cur + 1) % bufs.size();
+    if (bufs[next].busy) {
+      if (ring_fd >= 0)
+        while (bufs[next].busy) reap(true);
+      else
+        write_queued();
+    }
+    cur = next;
+  }
+
+  // waits for all submitted buffers
+  void drain_locked() {
+    if (ring_fd >= 0)
+      while (inflight > 0) reap(true);
+    else
+      write_queued();
+  }
+
+  // (fallback) writes queued buffers with a single pwritev
+  void write_queued() {
+    std::vector<struct iovec> iov;
+    std::size_t first = 0;
+    for (std::size_t k = 1; k <= bufs.size(); k++) {
+      Buffer& b = bufs[(cur + k) % bufs.size()];
+      if (!b.busy) continue;
+      if (iov.empty()) first = b.off;
+      iov.push_back({b.data.get(), b.used});
+    }
+    if (iov.empty()) return;
+    auto r = ::pwritev(fd, iov.data(), static_cast<int>(iov.size()),
+                       static_cast<off_t>(first));
+    std::size_t done = r < 0 ? 0 : static_cast<std::size_t>(r);
+    for (std::size_t k = 1; k <= bufs.size(); k++) {
+      Buffer& b = bufs[(cur + k) % bufs.size()];
+      if (!b.busy) continue;
+      // partial writes are finished with pwrite
+      if (done < b.used) write_at(b.data.get() + done, b.used - done,
+                                  b.off + done);
+      done -= std::min(done, b.used);
+      b.used = 0;
+      b.busy = false;
+    }
+  }
+
+  static int uring_setup(unsigned entries, io_uring_params* p) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+  }
+
+  int uring_enter(unsigned submit, unsigned wait, unsigned flags) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd, submit,
+                                      wait, flags, nullptr, 0));
+  }
+
+  int uring_register(unsigned op, const void* arg, unsigned n) {
+    return static_cast<int>(
+        ::syscall(__NR_io_uring_register, ring_fd, op, arg, n));
+  }
+
+  void setup_ring() {
+    auto entries = static_cast<unsigned>(bufs.size() * 2);
+    io_uring_params p{};
+    if (sqpoll) {
+      p.flags = IORING_SETUP_SQPOLL;
+      p.sq_thread_idle = 50;  // ms
+      ring_fd = uring_setup(entries, &p);
+    }
+    if (ring_fd < 0) {
+      p = io_uring_params{};
+      ring_fd = uring_setup(entries, &p);
+    }
+    if (ring_fd < 0) return;
+    polling = (p.flags & IORING_SETUP_SQPOLL) != 0;
+    sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) sq_size = cq_size = std::max(sq_size, cq_size);
+    sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+    sq_ptr = ::mmap(nullptr, sq_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    cq_ptr = single ? sq_ptr
+                    : ::mmap(nullptr, cq_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring_fd,
+                             IORING_OFF_CQ_RING);
+    void* s = ::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    int files[1] = {fd};
+    if (sq_ptr == MAP_FAILED || cq_ptr == MAP_FAILED || s == MAP_FAILED ||
+        uring_register(IORING_REGISTER_FILES, files, 1) < 0) {
+      if (s != MAP_FAILED) ::munmap(s, sqes_size);
+      sqes = nullptr;
+      close_ring();
+      return;
+    }
+    sqes = static_cast<io_uring_sqe*>(s);
+    auto* sq = static_cast<char*>(sq_ptr);
+    auto* cq = static_cast<char*>(cq_ptr);
+    sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_flags = reinterpret_cast<unsigned*>(sq + p.sq_off.flags);
+    sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+    // fixed buffers (may fail with a low RLIMIT_MEMLOCK: plain writes)
+    std::vector<struct iovec> iov;
+    for (auto& b : bufs) iov.push_back({b.data.get(), buffer_size});
+    fixed = uring_register(IORING_REGISTER_BUFFERS, iov.data(),
+                           static_cast<unsigned>(iov.size())) == 0;
+  }
+
+  void push_sqe(std::size_t i) {
+    Buffer& b = bufs[i];
+    unsigned tail = *sq_tail;
+    unsigned idx = tail & sq_mask;
+    io_uring_sqe& e = sqes[idx];
+    std::memset(&e, 0, sizeof(e));
+    e.opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    e.fd = 0;  // registered file
+    e.flags = IOSQE_FIXED_FILE;
+    e.addr = reinterpret_cast<std::uint64_t>(b.data.get());
+    e.len = static_cast<unsigned>(b.used);
+    e.off = b.off;
+    if (fixed) e.buf_index = static_cast<std::uint16_t>(i);
+    e.user_data = i;
+    sq_array[idx] = idx;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    inflight++;
+    if (polling) {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (__atomic_load_n(sq_flags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP)
+        uring_enter(0, 0, IORING_ENTER_SQ_WAKEUP);
+    } else {
+      uring_enter(1, 0, 0);
+    }
+  }
+
+  // takes completions (when 'wait', waits for at least one)
+  void reap(bool wait) {
+    unsigned head = *cq_head;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail && wait) {
+      uring_enter(0, 1, IORING_ENTER_GETEVENTS);
+      tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    }
+    for (; head != tail; head++) {
+      const io_uring_cqe& c = cqes[head & cq_mask];
+      Buffer& b = bufs[static_cast<std::size_t>(c.user_data)];
+      // partial writes are finished with pwrite
+      std::size_t done = c.res < 0 ? 0 : static_cast<std::size_t>(c.res);
+      if (done < b.used)
+        write_at(b.data.get() + done, b.used - done, b.off + done);
+      b.used = 0;
+      b.busy = false;
+      inflight--;
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+  }
+
+  void close_ring() {
+    if (sqes) ::munmap(sqes, sqes_size);
+    if (cq_ptr && cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+      ::munmap(cq_ptr, cq_size);
+    if (sq_ptr && sq_ptr != MAP_FAILED) ::munmap(sq_ptr, sq_size);
+    sqes = nullptr;
+    sq_ptr = cq_ptr = nullptr;
+    if (ring_fd >= 0) ::close(ring_fd);
+    ring_fd = -1;
+    inflight = 0;
+  }
+
+  void close_locked() {
+    if (fd < 0) return;
+    submit_locked();
+    drain_locked();
+    close_ring();
+    ::close(fd);
+    fd = -1;
+  }
+
+  std::mutex mtx;
+  int fd{-1};
+  std::size_t offset{0};
+  std::vector<Buffer> bufs;
+  std::size_t cur{0};
+  // io_uring state
+  int ring_fd{-1};
+  bool polling{false};
+  bool fixed{false};
+  unsigned inflight{0};
+  void* sq_ptr{nullptr};
+  void* cq_ptr{nullptr};
+  std::size_t sq_size{0};
+  std::size_t cq_size{0};
+  std::size_t sqes_size{0};
+  io_uring_sqe* sqes{nullptr};
+  unsigned* sq_tail{nullptr};
+  unsigned* sq_flags{nullptr};
+  unsigned* sq_array{nullptr};
+  unsigned sq_mask{0};
+  unsigned* cq_head{nullptr};
+  unsigned* cq_tail{nullptr};
+  unsigned cq_mask{0};
+  io_uring_cqe* cqes{nullptr};
+};
+#endif
+
+#ifndef _WIN32
+// what SyslogSink does when the socket buffer of the daemon is full
+MODLOG_MOD_EXPORT enum class SocketFull : int {
+  Block,  // waits until socket accepts records (however long it takes)
+  Drop,   // drops records not sent (see dropped())
+  Wait    // waits up to full_timeout for a batch, then drops (default)
+};
+
+// Sends records to the local syslog daemon (/dev/log, RFC 3164 style
+// "<PRI>ident[pid]: msg") or to journald native socket (open_journald()),
+// one datagram per record, with severity from record level. Records are
+// batched and sent together (sendmmsg(2) on Linux) when 'batch_size'
+// records are waiting, on flush(), at flush_policy.level (Warning by
+// default) and every flush_policy.interval (100ms). Headers are formatted
+// once per level on open. When the daemon restarts, socket is reconnected.
+MODLOG_MOD_EXPORT class SyslogSink : public LogSink {
+ public:
+  std::string ident{"modlog"};
+  int facility{1};  // user-level messages
+  std::size_t batch_size{64};
+  SocketFull when_full{SocketFull::Wait};
+  std::chrono::milliseconds full_timeout{std::chrono::milliseconds{10}};
+
+  SyslogSink() {
+    flush_policy = {LogLevel::Warning, 0, std::chrono::milliseconds{100}};
+  }
+  SyslogSink(const SyslogSink&) = delete;
+  SyslogSink& operator=(const SyslogSink&) = delete;
+  ~SyslogSink() override { close(); }
+
+  bool open(const std::string& path = "/dev/log") {
+    return open_socket(path, false);
+  }
+
+  bool open_journald(
+      const std::string& path = "/run/systemd/journal/socket") {
+    return open_socket(path, true);
+  }
+
+  bool is_open() const { return fd >= 0; }
+
+  // records not delivered (socket full, too large, or daemon gone)
+  std::size_t dropped() const {
+    return dropped_count.load(std::memory_order_relaxed);
+  }
+
+  void write(LogLevel l, std::string_view record) override {
+    std::lock_guard<std::mutex> lock{mtx};
+    if (fd < 0) return;
+    if (!record.empty() && record.back() == '\n') record.remove_suffix(1);
+    // batch is sent before 'body' or 'entries' would grow, so they only
+    // reallocate when empty (see crash_write())
+    std::size_t need = record.size() + (journald ? 17 : 0);
+    if (entries.size() >= entries.capacity() ||
+        body.size() + need > body.capacity()) {
+      send_locked();
+      if (need > body.capacity()) body.reserve(need);
+    }
+    std::size_t off = body.size();
+    if (journald && record.find('\n') != std::string_view::npos) {
+      // binary field: name, line break, 64-bit little-endian size, data
+      body.append("MESSAGE\n");
+      for (int i = 0; i < 8; i++)
+        body.push_back(static_cast<char>(
+            static_cast<std::uint64_t>(record.size()) >> (8 * i)));
+      body.append(record);
+      body.push_back('\n');
+    } else {
+      if (journald) body.append("MESSAGE=");
+      body.append(record);
+      if (journald) body.push_back('\n');
+    }
+    entries.push_back(Entry{off, body.size() - off, level_index(l)});
+    if (entries.size() >= batch_size) send_locked();
+  }
+
+  void flush() override {
+    std::lock_guard<std::mutex> lock{mtx};
+    send_locked();
+  }
+
+  void close() override {
+    flush_timer.remove(this);
+    std::lock_guard<std::mutex> lock{mtx};
+    if (fd < 0) return;
+    send_locked();
+    ::close(fd);
+    fd = -1;
+  }
+
+  void crash_write(std::string_view record) override {
+    if (fd < 0) return;
+    for (const auto& e : entries)
+      if (e.off + e.len <= body.size())
+        crash_send(e.level, body.data() + e.off, e.len);
+    entries.clear();
+    if (!record.empty() && record.back() == '\n') record.remove_suffix(1);
+    if (journald) {
+      // no allocation: records with line breaks are cut at first one
+      record = record.substr(0, record.find('\n'));
+      char buf[512];
+      std::size_t n = std::min(record.size(), sizeof(buf) - 9);
+      std::memcpy(buf, "MESSAGE=", 8);
+      std::memcpy(buf + 8, record.data(), n);
+      buf[8 + n] = '\n';
+      crash_send(level_index(LogLevel::Fatal), buf, n + 9);
+    } else {
+      crash_send(level_index(LogLevel::Fatal), record.data(), record.size());
+    }
+  }
+
+ private:
+  struct Entry {
+    std::size_t off;
+    std::size_t len;
+    int level;
+  };
+
+  static int level_index(LogLevel l) {
+    int i = static_cast<int>(l) + 1;
+    return std::min(std::max(i, 0), 4);
+  }
+
+  bool open_socket(const std::string& path, bool _journald) {
+    std::unique_lock<std::mutex> lock{mtx};
+    if (fd >= 0) {
+      send_locked();
+      ::close(fd);
+      fd = -1;
+    }
+    spath = path;
+    journald = _journald;
+    if (!connect_locked()) return false;
+    // debug, info, warning, error, critical
+    constexpr int severity[5] = {7, 6, 4, 3, 2};
+    std::string pid = std::to_string(::getpid());
+    for (int i = 0; i < 5; i++) {
+      int pri = facility * 8 + severity[i];
+      headers[i] = journald ? "PRIORITY=" + std::to_string(severity[i]) +
+                                  "\nSYSLOG_FACILITY=" +
+                                  std::to_string(facility) +
+                                  "\nSYSLOG_IDENTIFIER=" + ident +
+                                  "\nSYSLOG_PID=" + pid + "\n"
+                            : "<" + std::to_string(pri) + ">" + ident + "[" +
+                                  pid + "]: ";
+    }
+    body.clear();
+    entries.clear();
+    // (write() sends a batch before outgrowing them)
+    body.reserve(batch_size * 256);
+    entries.reserve(batch_size);
+    lock.unlock();
+    flush_timer.add(this);
+    return true;
+  }
+
+  bool connect_locked() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (spath.size() >= sizeof(addr.sun_path)) return false;
+    std::memcpy(addr.sun_path, spath.c_str(), spath.size() + 1);
+    int f = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (f < 0) return false;
+    ::fcntl(f, F_SETFD, FD_CLOEXEC);
+    if (::connect(f, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+      ::close(f);
+      return false;
+    }
+    fd = f;
+    return true;
+  }
+
+  // sends records from 'first', returning how many were sent (-1 on error)
+  int send_some(std::size_t first) {
+    std::size_t n = entries.size() - first;
+    iovs.resize(2 * n);
+    for (std::size_t i = 0; i < n; i++) {
+      const Entry& e = entries[first + i];
+      iovs[2 * i] = iovec{headers[e.level].data(), headers[e.level].size()};
+      iovs[2 * i + 1] = iovec{body.data() + e.off, e.len};
+    }
+#ifdef __linux__
+    msgs.resize(n);
+    for (std::size_t i = 0; i < n; i++) {
+      msgs[i] = mmsghdr{};
+      msgs[i].msg_hdr.msg_iov = &iovs[2 * i];
+      msgs[i].msg_hdr.msg_iovlen = 2;
+    }
+    return ::sendmmsg(fd, msgs.data(), static_cast<unsigned>(n),
+                      MSG_DONTWAIT);
+#else
+    msghdr m{};
+    m.msg_iov = iovs.data();
+    m.msg_iovlen = 2;
+    return ::sendmsg(fd, &m, MSG_DONTWAIT) < 0 ? -1 : 1;
+#endif
+  }
+
+  void send_locked() {
+    std::size_t sent = 0;
+    bool reconnected = false;
+    auto deadline = std::chrono::steady_clock::now() + full_timeout;
+    while (fd >= 0 && sent < entries.size()) {
+      int r = send_some(sent);
+      if (r > 0) {
+        sent += static_cast<std::size_t>(r);
+        continue;
+      }
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+        if (when_full == SocketFull::Drop) break;
+        int timeout = -1;
+        if (when_full == SocketFull::Wait) {
+          using namespace std::chrono;  // NOLINT
+          auto left = deadline - steady_clock::now();
+          timeout = static_cast<int>(duration_cast<milliseconds>(left).count());
+          if (timeout <= 0) break;
+        }
+        pollfd p{fd, POLLOUT, 0};
+        if (::poll(&p, 1, timeout) == 0) break;
+        continue;
+      }
+      if (errno == EMSGSIZE) {
+        // too large for a datagram: skipped
+        sent++;
+        dropped_count.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      // daemon restarted (or gone): reconnects once
+      if (reconnected || !connect_locked()) break;
+      reconnected = true;
+    }
+    dropped_count.fetch_add(entries.size() - sent, std::memory_order_relaxed);
+    entries.clear();
+    body.clear();
+  }
+
+  void crash_send(int level, const char* data, std::size_t n) {
+    iovec iov[2] = {{headers[level].data(), headers[level].size()},
+                    {const_cast<char*>(data), n}};
+    msghdr m{};
+    m.msg_iov = iov;
+    m.msg_iovlen = 2;
+    [[maybe_unused]] auto r = ::sendmsg(fd, &m, MSG_DONTWAIT);
+  }
+
+  std::mutex mtx;
+  int fd{-1};
+  bool journald{false};
+  std::string spath;
+  std::string headers[5];
+  std::string body;
+  std::vector<Entry> entries;
+  std::vector<iovec> iovs;
+#ifdef __linux__
+  std::vector<mmsghdr> msgs;
+#endif
+  std::atomic<std::size_t> dropped_count{0};
+};
+
+// transport and framing of NetworkSink records
+MODLOG_MOD_EXPORT enum class Transport : int { Tcp, Udp };
+MODLOG_MOD_EXPORT enum class Framing : int {
+  Lines,  // records as rendered, each ending with '\n' (NDJSON with
+          // json_format)
+  Length  // 4-byte big-endian size, then record without its '\n'
+};
+
+// Ships records to a collector over TCP (a stream of framed records) or
+// UDP (datagrams of up to max_datagram bytes, with whole records). Records
+// are batched by a sender thread, sent when batch_bytes are waiting or every
+// batch_interval. While the collector is down, unsent records are kept
+// (up to spill_size bytes, oldest are dropped beyond it) and connection is
+// retried with exponential backoff. Records are resent from the first one
+// not completely sent, so the collector should discard a partial record at
+// the end of a broken connection.
+MODLOG_MOD_EXPORT class NetworkSink : public LogSink {
+ public:
+  Transport transport{Transport::Tcp};
+  Framing framing{Framing::Lines};
+  std::size_t batch_bytes{64 * 1024};
+  std::chrono::milliseconds batch_interval{std::chrono::milliseconds{100}};
+  std::size_t max_datagram{1400};
+  std::size_t spill_size{64 * 1024 * 1024};
+  std::chrono::milliseconds backoff_min{std::chrono::milliseconds{100}};
+  std::chrono::milliseconds backoff_max{std::chrono::seconds{10}};
+  // limit of connect and of each blocked send
+  std::chrono::milliseconds io_timeout{std::chrono::seconds{2}};
+
+  NetworkSink() = default;
+  NetworkSink(const NetworkSink&) = delete;
+  NetworkSink& operator=(const NetworkSink&) = delete;
+  ~NetworkSink() override { close(); }
+
+  // resolves collector address and starts sender (which connects)
+  bool open(const std::string& host, int port) {
+    close();
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype =
+        transport == Transport::Tcp ? SOCK_STREAM : SOCK_DGRAM;
+    addrinfo* res = nullptr;
+    if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints,
+                      &res) != 0 ||
+        !res)
+      return false;
+    std::memcpy(&addr, res->ai_addr, res->ai_addrlen);
+    addr_len = res->ai_addrlen;
+    ::freeaddrinfo(res);
+    std::lock_guard<std::mutex> lock{mtx};
+    quit = false;
+    backoff = backoff_min;
+    next_attempt = std::chrono::steady_clock::now();
+    sender = std::thread{[this]() { run(); }};
+    return true;
+  }
+
+  bool is_open() const { return sender.joinable(); }
+
+  bool connected() const { return sock.load(std::memory_order_acquire) >= 0; }
+
+  // records dropped (spill full, too large for a datagram, or pending on
+  // close)
+  std::size_t dropped() const {
+    return dropped_count.load(std::memory_order_relaxed);
+  }
+
+  // records completely sent
+  std::size_t sent() const {
+    return sent_count.load(std::memory_order_relaxed);
+  }
+
+  void write(LogLevel, std::string_view record) override {
+    std::lock_guard<std::mutex> lock{mtx};
+    if (!sender.joinable()) return;
+    if (pending.size() + record.size() + 4 > spill_size) {
+      dropped_count.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    if (framing == Framing::Length) {
+      if (!record.empty() && record.back() == '\n') record.remove_suffix(1);
+      auto n = static_cast<std::uint32_t>(record.size());
+      for (int i = 3; i >= 0; i--)
+        pending.push_back(static_cast<char>(n >> (8 * i)));
+    }
+    pending.append(record);
+    pending_ends.push_back(pending.size());
+    if (pending.size() >= batch_bytes) cv.notify_one();
+  }
+
+  // waits for one send attempt of all records written before it
+  void flush() override {
+    std::unique_lock<std::mutex> lock{mtx};
+    if (!sender.joinable()) return;
+    auto id = ++flush_requested;
+    cv.notify_one();
+    done_cv.wait(lock, [this, id]() { return flush_done >= id; });
+  }
+
+  // sends what it can (one attempt) and stops sender
+  void close() override {
+    {
+      std::lock_guard<std::mutex> lock{mtx};
+      if (!sender.joinable()) return;
+      quit = true;
+    }
+    cv.notify_one();
+    sender.join();
+    dropped_count.fetch_add(backlog_ends.size(), std::memory_order_relaxed);
+    backlog.clear();
+    backlog_ends.clear();
+    disconnect();
+  }
+
+ private:
+  void run() {
+    std::unique_lock<std::mutex> lock{mtx};
+    for (;;) {
+      cv.wait_for(lock, batch_interval, [this]() {
+        return quit || flush_done != flush_requested ||
+               pending.size() >= batch_bytes;
+      });
+      take_pending();
+      bool stopping = quit;
+      auto id = flush_requested;
+      lock.unlock();
+      if (!backlog.empty()) send_backlog();
+      lock.lock();
+      flush_done = id;
+      done_cv.notify_all();
+      if (stopping) return;
+    }
+  }
+
+  // (sender, locked) moves pending records to backlog, dropping oldest
+  // records of backlog beyond spill_size
+  void take_pending() {
+    std::size_t base = backlog.size();
+    backlog.append(pending);
+    for (auto e : pending_ends) backlog_ends.push_back(base + e);
+    pending.clear();
+    pending_ends.clear();
+    if (backlog.size() <= spill_size) return;
+    std::size_t k = 0;
+    while (k < backlog_ends.size() &&
+           backlog.size() - backlog_ends[k] > spill_size)
+      k++;
+    k = std::min(k + 1, backlog_ends.size());
+    erase_records(k);
+    dropped_count.fetch_add(k, std::memory_order_relaxed);
+  }
+
+  // (sender) removes first 'k' records from backlog
+  void erase_records(std::size_t k) {
+    if (k == 0) return;
+    std::size_t cut = backlog_ends[k - 1];
+    backlog.erase(0, cut);
+    backlog_ends.erase(backlog_ends.begin(),
+                       backlog_ends.begin() + static_cast<std::ptrdiff_t>(k));
+    for (auto& e : backlog_ends) e -= cut;
+  }
+
+  // (sender) sends backlog, keeping what was not completely sent
+  void send_backlog() {
+    if (sock.load(std::memory_order_relaxed) >= 0 && peer_closed())
+      disconnect();
+    if (sock.load(std::memory_order_relaxed) < 0 && !connect_now()) return;
+    int s = sock.load(std::memory_order_relaxed);
+    std::size_t k = 0;  // records completely sent (or dropped)
+    std::size_t too_large = 0;
+    if (transport == Transport::Tcp) {
+      std::size_t off = 0;
+      while (off < backlog.size()) {
+        auto r = ::send(s, backlog.data() + off, backlog.size() - off,
+                        send_flags);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) {
+          disconnect();
+          break;
+        }
+        off += static_cast<std::size_t>(r);
+      }
+      while (k < backlog_ends.size() && backlog_ends[k] <= off) k++;
+    } else {
+      // datagrams of whole records (a larger record goes alone)
+      std::size_t start = 0;
+      std::size_t limit = max_datagram;
+      while (k < backlog_ends.size()) {
+        std::size_t j = k + 1;
+        while (j < backlog_ends.size() && backlog_ends[j] - start <= limit)
+          j++;
+        auto r = ::send(s, backlog.data() + start, backlog_ends[j - 1] - start,
+                        send_flags);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0 && errno == EMSGSIZE) {
+          // datagram over system limit: records are then sent one by one,
+          // and a single record too large for it is dropped
+          if (j - k > 1) {
+            limit = 0;
+            continue;
+          }
+          too_large++;
+        } else if (r < 0) {
+          disconnect();
+          break;
+        }
+        k = j;
+        start = backlog_ends[j - 1];
+      }
+    }
+    erase_records(k);
+    dropped_count.fetch_add(too_large, std::memory_order_relaxed);
+    sent_count.fetch_add(k - too_large, std::memory_order_relaxed);
+  }
+
+  // (sender) tcp connection closed (or reset) by collector
+  bool peer_closed() {
+    if (transport != Transport::Tcp) return false;
+    pollfd p{sock.load(std::memory_order_relaxed), POLLIN, 0};
+    if (::poll(&p, 1, 0) <= 0) return false;
+    char c;
+    auto r = ::recv(p.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+  }
+
+  // (sender) connects, unless it is too early after last failure
+  bool connect_now() {
+    auto now = std::chrono::steady_clock::now();
+    if (now < next_attempt) return false;
+    int s = ::socket(addr.ss_family,
+                     transport == Transport::Tcp ? SOCK_STREAM : SOCK_DGRAM,
+                     0);
+    bool ok = s >= 0;
+    if (ok) {
+      ::fcntl(s, F_SETFD, FD_CLOEXEC);
+      ::fcntl(s, F_SETFL, ::fcntl(s, F_GETFL) | O_NONBLOCK);
+      int r = ::connect(s, reinterpret_cast<sockaddr*>(&addr), addr_len);
+      if (r != 0 && errno == EINPROGRESS) {
+        pollfd p{s, POLLOUT, 0};
+        int err = 0;
+        socklen_t len = sizeof(err);
+        r = (::poll(&p, 1, static_cast<int>(io_timeout.count())) == 1 &&
+             ::getsockopt(s, SOL_SOCKET, SO_ERROR, &err, &len) == 0 &&
+             err == 0)
+                ? 0
+                : -1;
+      }
+      ok = r == 0;
+    }
+    if (!ok) {
+      if (s >= 0) ::close(s);
+      next_attempt = now + backoff;
+      backoff = std::min(backoff * 2, backoff_max);
+      return false;
+    }
+    ::fcntl(s, F_SETFL, ::fcntl(s, F_GETFL) & ~O_NONBLOCK);
+    timeval tv{};
+    tv.tv_sec = static_cast<decltype(tv.tv_sec)>(io_timeout.count() / 1000);
+    tv.tv_usec =
+        static_cast<decltype(tv.tv_usec)>(io_timeout.count() % 1000 * 1000);
+    ::setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    ::setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    backoff = backoff_min;
+    sock.store(s, std::memory_order_release);
+    return true;
+  }
+
+  void disconnect() {
+    int s = sock.exchange(-1, std::memory_order_acq_rel);
+    if (s >= 0) ::close(s);
+  }
+
+#ifdef MSG_NOSIGNAL
+  static constexpr int send_flags = MSG_NOSIGNAL;
+#else
+  static constexpr int send_flags = 0;
+#endif
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::condition_variable done_cv;
+  std::thread sender;
+  bool quit{false};
+  std::uint64_t flush_requested{0};
+  std::uint64_t flush_done{0};
+  // written by producers (end offset of each record)
+  std::string pending;
+  std::vector<std::size_t> pending_ends;
+  // owned by sender: records not sent yet
+  std::string backlog;
+  std::vector<std::size_t> backlog_ends;
+  sockaddr_storage addr{};
+  socklen_t addr_len{0};
+  std::atomic<int> sock{-1};
+  std::chrono::milliseconds backoff{0};
+  std::chrono::steady_clock::time_point next_attempt;
+  std::atomic<std::size_t> dropped_count{0};
+  std::atomic<std::size_t> sent_count{0};
+};
+#endif
+
+// lowest level kept by flight recorder (Disabled when it is not running)
+MODLOG_MOD_EXPORT inline std::atomic<LogLevel> flight_minlog{
+    LogLevel::Disabled};
+
+#ifndef _WIN32
+// Crash flight recorder: ring with last 'capacity' bytes of text records, in
+// a shared mapping of a file, so that recent history survives a crash or a
+// kill -9 (see recover()). Each record is written with a lock-free memcpy
+// on a reserved range; a writer that is a whole lap behind may overwrite it.
+MODLOG_MOD_EXPORT class FlightRecorder : public LogSink {
+ public:
+  // file layout: header (magic, capacity, head), followed by ring
+  struct Header {
+    char magic[8];
+    std::uint64_t capacity;
+    std::atomic<std::uint64_t> head;  // bytes ever written
+  };
+  static_assert(sizeof(std::atomic<std::uint64_t>) == 8);
+  static constexpr char magic[8] = {'M', 'O', 'D', 'L', 'O', 'G', 'F', 'R'};
+  static constexpr std::size_t data_offset = 64;
+
+  FlightRecorder() = default;
+  FlightRecorder(const FlightRecorder&) = delete;
+  FlightRecorder& operator=(const FlightRecorder&) = delete;
+  ~FlightRecorder() override { close(); }
+
+  // creates (or resets) ring file with 'capacity' bytes of records; a ring
+  // with records left by a previous run (e.g., one that crashed) is first
+  // moved to <path>.prev, where recover() still finds them
+  bool open(const std::string& path, std::size_t capacity) {
+    close();
+    if (capacity == 0) return false;
+    if (has_records(path)) ::rename(path.c_str(), (path + ".prev").c_str());
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0664);
+    if (fd < 0) return false;
+    std::size_t size = data_offset + capacity;
+    void* p = MAP_FAILED;
+    if (::ftruncate(fd, static_cast<off_t>(size)) == 0)
+      p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return false;
+    map_size = size;
+    auto* h = new (p) Header{};
+    std::memcpy(h->magic, magic, sizeof(magic));
+    h->capacity = capacity;
+    data = static_cast<char*>(p) + data_offset;
+    hdr.store(h);
+    return true;
+  }
+
+  bool is_open() const { return hdr.load() != nullptr; }
+
+  void write(LogLevel, std::string_view record) override {
+    writers.fetch_add(1);
+    if (Header* h = hdr.load()) {
+      std::uint64_t cap = h->capacity;
+      if (record.size() > cap) record = record.substr(record.size() - cap);
+      auto n = static_cast<std::uint64_t>(record.size());
+      auto pos = h->head.fetch_add(n, std::memory_order_relaxed) % cap;
+      auto first = std::min(n, cap - pos);
+      std::memcpy(data + pos, record.data(), first);
+      std::memcpy(data, record.data() + first, n - first);
+    }
+    writers.fetch_sub(1);
+  }
+
+  void crash_write(std::string_view record) override {
+    write(LogLevel::Fatal, record);
+  }
+
+  void close() override {
+    Header* h = hdr.exchange(nullptr);
+    if (!h) return;
+    while (writers.load() != 0)
+      std::this_thread::yield();
+    ::munmap(h, map_size);
+    data = nullptr;
+  }
+
+  // oldest to newest complete records kept on ring file 'path' (also after
+  // a crash of the writer process); empty if it is not a ring file
+  static std::string recover(const std::string& path) {
+    std::ifstream f{path, std::ios::binary};
+    std::string file{std::istreambuf_iterator<char>{f}, {}};
+    if (file.size() < data_offset ||
+        std::memcmp(file.data(), magic, sizeof(magic)) != 0)
+      return {};
+    std::uint64_t cap = 0;
+    std::uint64_t head = 0;
+    std::memcpy(&cap, file.data() + 8, sizeof(cap));
+    std::memcpy(&head, file.data() + 16, sizeof(head));
+    if (file.size() < data_offset + cap) return {};
+    std::string_view ring{file.data() + data_offset,
+                          static_cast<std::size_t>(cap)};
+    std::string out;
+    if (head <= cap) {
+      out.assign(ring.substr(0, static_cast<std::size_t>(head)));
+    } else {
+      auto pos = static_cast<std::size_t>(head % cap);
+      out.assign(ring.substr(pos));
+      out.append(ring.substr(0, pos));
+      // first record was partially overwritten
+      auto nl = out.find('\n');
+      out.erase(0, nl == std::string::npos ? out.size() : nl + 1);
+    }
+    // ranges reserved by writers that never finished
+    out.erase(std::remove(out.begin(), out.end(), '\0'), out.end());
+    return out;
+  }
+
+ private:
+  // true if 'path' is a whole ring file with some record written
+  static bool has_records(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    char h[24];
+    struct stat st {};
+    bool ok = ::pread(fd, h, sizeof(h), 0) == sizeof(h) &&
+              ::fstat(fd, &st) == 0 &&
+              std::memcmp(h, magic, sizeof(magic)) == 0;
+    ::close(fd);
+    std::uint64_t cap = 0;
+    std::uint64_t head = 0;
+    std::memcpy(&cap, h + 8, sizeof(cap));
+    std::memcpy(&head, h + 16, sizeof(head));
+    return ok && head > 0 &&
+           static_cast<std::uint64_t>(st.st_size) >= data_offset + cap;
+  }
+
+  std::atomic<Header*> hdr{nullptr};
+  char* data{nullptr};
+  std::size_t map_size{0};
+  std::atomic<int> writers{0};
+};
+
+MODLOG_MOD_EXPORT inline FlightRecorder flight_recorder;
+#endif
+
+// glog-style log files, one for each level (INFO, WARNING, ERROR, FATAL):
+//   <dir>/<app>.<host>.<user>.log.<LEVEL>.<yyyymmdd-hhmmss>.<pid>
+// each file receives records of its level and above (INFO has everything).
+// Files are created on first record of its level (INFO on open).
+// With time rotation, <yyyymmdd-hhmmss> is the start of current period.
+MODLOG_MOD_EXPORT class LogFiles : public LogSink {
+ public:
+  static constexpr const char* level_names[4] = {"INFO", "WARNING", "ERROR",
+                                                 "FATAL"};
+  // rotation and retention of each file (see FileSink), set before open
+  std::size_t max_size{0};
+  Rotation rotation{Rotation::Off};
+  std::chrono::seconds max_age{0};
+  // LZ4 frame files (names end with .lz4), set before open
+  bool compress{false};
+
+  LogFiles() = default;
+  ~LogFiles() override { close(); }
+
+  bool open(std::string_view app_name, std::string_view log_dir = {}) {
+    close();
+    std::lock_guard<std::mutex> lock{mtx};
+    std::string dir{log_dir};
+    if (dir.empty()) dir = default_log_dir();
+    if (dir.back() != '/' && dir.back() != '\\') dir += '/';
+
+    std::string app{app_name};
+    auto pos = app.find_last_of("/\\");
+    if (pos != std::string::npos) app = app.substr(pos + 1);
+    if (app.empty()) app = "modlog";
+
+    host = host_name();
+    link_base = dir + app + ".";
+    base = dir + app + "." + host + "." + user_name() + ".log.";
+    pid_suffix = "." + std::to_string(process_id());
+    stamp = file_stamp(std::time(nullptr));
+    return open_file(0);
+  }
+
+  void write(LogLevel l, std::string_view record) override {
+    write_at(l, record, std::chrono::system_clock::now());
+  }
+
+  void write_at(LogLevel l, std::string_view record,
+                std::chrono::system_clock::time_point time) override {
+    int n = level_index(l);
+    for (int i = 0; i <= n; i++) {
+      if (!files[i].is_open()) {
+        std::lock_guard<std::mutex> lock{mtx};
+        if (!files[i].is_open() && !open_file(i)) continue;
+      }
+      files[i].write_at(l, record, time);
+      files[i].written(l, record.size());
+    }
+  }
+
+  void flush() override {
+    for (auto& f : files) f.flush();
+  }
+
+  void crash_write(std::string_view record) override {
+    for (auto& f : files) f.crash_write(record);
+  }
+
+  void close() override {
+    std::lock_guard<std::mutex> lock{mtx};
+    base.clear();
+    for (auto& f : files) f.close();
+  }
+
+  FileSink& file(LogLevel l) { return files[level_index(l)]; }
+
+  static int level_index(LogLevel l) {
+    if (l >= LogLevel::Fatal) return 3;
+    if (l <= LogLevel::Info) return 0;
+    return static_cast<int>(l);
+  }
+
+ private:
+  static std::string default_log_dir() {
+    for (const char* env : {"TMPDIR", "TMP", "TEMP"}) {
+      const char* v = std::getenv(env);
+      if (v && *v) return v;
+    }
+#ifdef _WIN32
+    return ".";
+#else
+    return "/tmp";
+#endif
+  }
+
+  static std::string host_name() {
+#ifdef _WIN32
+    const char* v = std::getenv("COMPUTERNAME");
+    return (v && *v) ? v : "unknown";
+#else
+    char buf[256]{};
+    if (::gethostname(buf, sizeof(buf) - 1) != 0 || !buf[0]) return "unknown";
+    return buf;
+#endif
+  }
+
+  static std::string user_name() {
+    for (const char* env : {"USER", "USERNAME"}) {
+      const char* v = std::getenv(env);
+      if (v && *v) return v;
+    }
+    return "unknown";
+  }
+
+  static long process_id() {
+#ifdef _WIN32
+    return static_cast<long>(::_getpid());
+#else
+    return static_cast<long>(::getpid());
+#endif
+  }
+
+  // must hold mtx
+  bool open_file(int i) {
+    if (base.empty()) return false;
+    FileSink& f = files[i];
+    f.max_size = max_size;
+    f.rotation = rotation;
+    f.max_age = max_age;
+    f.compress = compress;
+    f.link = link_base + level_names[i];
+    std::string suffix = pid_suffix + (compress ? ".lz4" : "");
+    bool ok = (rotation == Rotation::Off)
+                  ? f.open(base + level_names[i] + "." + stamp + suffix)
+                  : f.open(base + level_names[i], suffix);
+    if (!ok) return false;
+
+    auto now_tm = local_tm(std::time(nullptr));
+    std::ostringstream header;
+    header << "Log file created at: " << (now_tm.tm_year + 1900) << '/'
+           << std::setw(2) << std::setfill('0') << (now_tm.tm_mon + 1) << '/'
+           << std::setw(2) << now_tm.tm_mday << ' ' << std::setw(2)
+           << now_tm.tm_hour << ':' << std::setw(2) << now_tm.tm_min << ':'
+           << std::setw(2) << now_tm.tm_sec << '\n'
+           << "Running on machine: " << host << '\n'
+           << "Log line format: [DIWEF]yyyymmdd hh:mm:ss.uuuuuu threadid "
+              "file:line] msg\n";
+    f.write(LogLevel::Info, header.str());
+    return true;
+  }
+
+  std::mutex mtx;
+  std::string host;
+  std::string base;
+  std::string stamp;
+  std::string pid_suffix;
+  std::string link_base;
+  FileSink files[4];
+};
+
+MODLOG_MOD_EXPORT inline LogFiles log_files;
+
+// =======================================
+//         binary record files
+// =======================================
+
+// first byte of records rendered with binary_format
+inline constexpr char binary_mark = '\x1e';
+
+// Compact binary log file, for records rendered with binary_format:
+//   file:    "MODLOGB1", then items, each a tag byte and LEB128 varints
+//   'S'      segment start (callsite ids and time base are reset)
+//   'C'      callsite: id, line, file name size, file name
+//   'R'      record: level + 2 (1 byte), callsite id, thread id, zigzag
+//            time delta (us, from previous record of segment, or from 0),
+//            message size, message
+// Every 'segment_bytes', the segment is closed and indexed on sidecar file
+// "<path>.idx", with 32 bytes per segment (little-endian int64): first and
+// last record times (wall_time_us) and begin and end file offsets. So a
+// reader (BinaryLogReader) only decodes segments of a given time range.
+MODLOG_MOD_EXPORT class BinaryFileSink : public LogSink {
+ public:
+  std::size_t segment_bytes{4u << 20};
+  std::size_t buffer_size{64 * 1024};
+
+  BinaryFileSink() = default;
+  BinaryFileSink(const BinaryFileSink&) = delete;
+  BinaryFileSink& operator=(const BinaryFileSink&) = delete;
+  ~BinaryFileSink() override { close(); }
+
+  // appends to 'path' (a new segment starts at end of file)
+  bool open(const std::string& path) {
+    close();
+    std::lock_guard<std::mutex> lock{mtx};
+    fd = file_open_append(path);
+    if (fd < 0) return false;
+    idx_fd = file_open_append(path + ".idx");
+    offset = file_size(fd);
+    if (offset == 0) append("MODLOGB1", 8);
+    return true;
+  }
+
+  bool is_open() {
+    std::lock_guard<std::mutex> lock{mtx};
+    return fd >= 0;
+  }
+
+  // records not rendered with binary_format are kept as messages
+  void write(LogLevel l, std::string_view record) override {
+    std::lock_guard<std::mutex> lock{mtx};
+    if (fd < 0) return;
+    std::uint64_t level = static_cast<std::uint64_t>(static_cast<int>(l) + 2);
+    std::uint64_t time = static_cast<std::uint64_t>(last_time), tid = 0;
+    std::uint64_t line = 0, size = 0, msize = record.size();
+    std::string_view file, msg = record;
+    std::size_t p = 2;
+    if (record.size() > 2 && record[0] == binary_mark &&
+        get_varint(record, p, time) && get_varint(record, p, tid) &&
+        get_varint(record, p, line) && get_varint(record, p, size) &&
+        p + size <= record.size()) {
+      level = static_cast<unsigned char>(record[1]);
+      file = record.substr(p, size);
+      p += size;
+      if (get_varint(record, p, msize) && p + msize <= record.size())
+        msg = record.substr(p, msize);
+    }
+    if (seg_begin == npos) begin_segment();
+    std::uint64_t id = callsite(file, line);
+    char h[48];
+    char* e = h;
+    *e++ = 'R';
+    *e++ = static_cast<char>(level);
+    e = put_varint(e, id);
+    e = put_varint(e, tid);
+    auto t = static_cast<std::int64_t>(time);
+    std::int64_t d = t - last_time;
+    e = put_varint(e, (static_cast<std::uint64_t>(d) << 1) ^
+                          static_cast<std::uint64_t>(d >> 63));
+    e = put_varint(e, msg.size());
+    append(h, static_cast<std::size_t>(e - h));
+    append(msg.data(), msg.size());
+    last_time = t;
+    first = std::min(first, t);
+    last = std::max(last, t);
+    if (offset - seg_begin >= segment_bytes) end_segment();
+  }
+
+  void flush() override {
+    std::lock_guard<std::mutex> lock{mtx};
+    flush_locked();
+  }
+
+  // closes current segment, so that it is indexed
+  void close() override {
+    std::lock_guard<std::mutex> lock{mtx};
+    if (fd < 0) return;
+    end_segment();
+    flush_locked();
+    file_close(fd);
+    if (idx_fd >= 0) file_close(idx_fd);
+    fd = idx_fd = -1;
+  }
+
+  void crash_write(std::string_view) override {
+    if (fd >= 0) file_write_all(fd, buf.data(), buf.size());
+  }
+
+ private:
+  static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+  struct Callsite {
+    std::uint64_t id;
+    std::uint64_t line;
+    std::string file;
+  };
+
+  std::mutex mtx;
+  int fd{-1};
+  int idx_fd{-1};
+  std::string buf;
+  std::size_t offset{0};  // file size, including 'buf'
+  std::size_t seg_begin{npos};
+  std::int64_t last_time{0};
+  std::int64_t first{0};
+  std::int64_t last{0};
+  std::unordered_map<std::uint64_t, Callsite> callsites;
+  std::uint64_t next_id{0};
+
+  void append(const char* data, std::size_t n) {
+    buf.append(data, n);
+    offset += n;
+    if (buf.size() >= buffer_size) flush_locked();
+  }
+
+  void flush_locked() {
+    if (fd >= 0 && !buf.empty()) file_write_all(fd, buf.data(), buf.size());
+    buf.clear();
+  }
+
+  void begin_segment() {
+    seg_begin = offset;
+    callsites.clear();
+    next_id = 0;
+    last_time = 0;
+    first = std::numeric_limits<std::int64_t>::max();
+    last = std::numeric_limits<std::int64_t>::min();
+    append("S", 1);
+  }
+
+  void end_segment() {
+    if (seg_begin == npos) return;
+    // data first, so that index never points past it
+    flush_locked();
+    char e[32];
+    std::int64_t v[4] = {first, last, static_cast<std::int64_t>(seg_begin),
+                         static_cast<std::int64_t>(offset)};
+    for (int i = 0; i < 4; i++)
+      for (int b = 0; b < 8; b++)
+        e[i * 8 + b] = static_cast<char>(static_cast<std::uint64_t>(v[i]) >>
+                                         (8 * b));
+    if (idx_fd >= 0) file_write_all(idx_fd, e, sizeof(e));
+    seg_begin = npos;
+  }
+
+  // id of callsite, defined on segment when first seen
+  std::uint64_t callsite(std::string_view file, std::uint64_t line) {
+    std::uint64_t key = std::hash<std::string_view>{}(file) * 31 + line;
+    auto it = callsites.find(key);
+    if (it != callsites.end() && it->second.line == line &&
+        it->second.file == file)
+      return it->second.id;
+    Callsite c{++next_id, line, std::string{file}};
+    char h[32];
+    char* e = h;
+    *e++ = 'C';
+    e = put_varint(e, c.id);
+    e = put_varint(e, line);
+    e = put_varint(e, file.size());
+    append(h, static_cast<std::size_t>(e - h));
+    append(file.data(), file.size());
+    callsites[key] = std::move(c);
+    return next_id;
+  }
+};
+
+// record of a binary log file (views are valid during callback only)
+MODLOG_MOD_EXPORT struct BinaryRecord {
+  LogLevel level{LogLevel::Info};
+  std::int64_t time{0};  // wall_time_us
+  std::uint64_t tid{0};
+  std::string_view file;
+  int line{0};
+  std::string_view msg;
+};
+
+// Reads files of BinaryFileSink, using its sidecar index to decode only
+// segments within a time range (unindexed parts, e.g., after a crash, are
+// always decoded).
+MODLOG_MOD_EXPORT class BinaryLogReader {
+ public:
+  struct Segment {
+    std::int64_t first, last;
+    std::size_t begin, end;
+    bool indexed;
+  };
+
+  bool open(const std::string& _path) {
+    path = _path;
+    segments.clear();
+    std::error_code ec;
+    auto size = static_cast<std::size_t>(std::filesystem::file_size(path, ec));
+    if (ec || size < 8) return false;
+    char magic[8]{};
+    std::ifstream{path, std::ios::binary}.read(magic, sizeof(magic));
+    if (std::string_view(magic, 8) != "MODLOGB1") return false;
+    std::ifstream idx{path + ".idx", std::ios::binary};
+    char e[32];
+    std::size_t pos = 8;
+    while (idx.read(e, sizeof(e))) {
+      std::int64_t v[4];
+      for (int i = 0; i < 4; i++) {
+        std::uint64_t u = 0;
+        for (int b = 0; b < 8; b++)
+          u |= static_cast<std::uint64_t>(static_cast<unsigned char>(
+                   e[i * 8 + b]))
+               << (8 * b);
+        v[i] = static_cast<std::int64_t>(u);
+      }
+      auto begin = static_cast<std::size_t>(v[2]);
+      auto end = static_cast<std::size_t>(v[3]);
+      if (begin < pos || end > size || begin > end) break;
+      if (begin > pos) segments.push_back({0, 0, pos, begin, false});
+      segments.push_back({v[0], v[1], begin, end, true});
+      pos = end;
+    }
+    if (pos < size) segments.push_back({0, 0, pos, size, false});
+    return true;
+  }
+
+  // calls f(const BinaryRecord&) for records with time in [from, to)
+  template <typename F>
+  void for_range(std::int64_t from, std::int64_t to, F f) {
+    std::ifstream in{path, std::ios::binary};
+    std::string data;
+    for (const auto& s : segments) {
+      if (s.indexed && (s.last < from || s.first >= to)) continue;
+      data.resize(s.end - s.begin);
+      in.seekg(static_cast<std::streamoff>(s.begin));
+      if (!in.read(data.data(), static_cast<std::streamsize>(data.size())))
+        data.resize(static_cast<std::size_t>(in.gcount()));
+      in.clear();
+      decoded++;
+      decode(data, [&](const BinaryRecord& r) {
+        if (r.time >= from && r.time < to) f(r);
+      });
+    }
+  }
+
+  template <typename F>
+  void for_each(F f) {
+    for_range(std::numeric_limits<std::int64_t>::min(),
+              std::numeric_limits<std::int64_t>::max(), f);
+  }
+
+  const std::vector<Segment>& index() const { return segments; }
+  // segments decoded so far
+  std::size_t decoded{0};
+
+  // decodes items of 'data', from a segment start (stops on truncated items)
+  template <typename F>
+  static void decode(std::string_view data, F f) {
+    std::vector<std::pair<std::string_view, std::uint64_t>> sites;
+    std::int64_t time = 0;
+    std::size_t p = 0;
+    while (p < data.size()) {
+      char tag = data[p++];
+      std::uint64_t id, line, n, tid, d;
+      if (tag == 'S') {
+        sites.clear();
+        time = 0;
+      } else if (tag == 'C') {
+        if (!get_varint(data, p, id) || !get_varint(data, p, line) ||
+            !get_varint(data, p, n) || n > data.size() - p)
+          return;
+        if (id >= sites.size()) sites.resize(id + 1);
+        sites[id] = {data.substr(p, n), line};
+        p += n;
+      } else if (tag == 'R' && p < data.size()) {
+        BinaryRecord r;
+        r.level = static_cast<LogLevel>(
+            static_cast<int>(static_cast<unsigned char>(data[p++])) - 2);
+        if (!get_varint(data, p, id) || !get_varint(data, p, tid) ||
+            !get_varint(data, p, d) || !get_varint(data, p, n) ||
+            n > data.size() - p)
+          return;
+        time += static_cast<std::int64_t>((d >> 1) ^ (~(d & 1) + 1));
+        r.time = time;
+        r.tid = tid;
+        if (id < sites.size()) {
+          r.file = sites[id].first;
+          r.line = static_cast<int>(sites[id].second);
+        }
+        r.msg = data.substr(p, n);
+        p += n;
+        f(r);
+      } else {
+        return;
+      }
+    }
+  }
+
+ private:
+  std::string path;
+  std::vector<Segment> segments;
+};
+
+// reads a time as digits "yyyymmdd hhmmss uuuuuu" (separators ' ', '-', ':',
+// '.', 'T' and 'Z' are skipped; missing trailing fields are zero) into 't'
+// (see wall_time_us)
+MODLOG_MOD_EXPORT inline bool parse_wall_time(std::string_view s,
+                                              std::int64_t& t) {
+  int d[20]{};
+  int n = 0;
+  for (char c : s) {
+    if (c >= '0' && c <= '9') {
+      d[n++] = c - '0';
+      if (n == 20) break;
+    } else if (c != ' ' && c != '-' && c != ':' && c != '.' && c != 'T' &&
+               c != 'Z') {
+      break;
+    }
+  }
+  if (n < 8) return false;
+  auto num = [&d](int from, int len) {
+    int v = 0;
+    for (int i = from; i < from + len; i++) v = v * 10 + d[i];
+    return v;
+  };
+  std::tm tm{};
+  tm.tm_year = num(0, 4) - 1900;
+  tm.tm_mon = num(4, 2) - 1;
+  tm.tm_mday = num(6, 2);
+  tm.tm_hour = num(8, 2);
+  tm.tm_min = num(10, 2);
+  tm.tm_sec = num(12, 2);
+  t = wall_time_us(tm, std::chrono::microseconds{num(14, 6)});
+  return true;
+}
+
+// format of a log file, as detected by LogFileView
+MODLOG_MOD_EXPORT enum class LogFileFormat { Text, Json, Logfmt, Binary };
+
+// record of a LogFileView, as views of file contents (time is wall_time_us;
+// messages keep JSON and logfmt escapes; 'text' is empty on binary files)
+MODLOG_MOD_EXPORT struct LogRecordView {
+  LogLevel level{LogLevel::Info};
+  std::int64_t time{0};
+  std::string_view file;
+  int line{0};
+  std::string_view msg;
+  std::string_view text;
+};
+
+// Read-only view of a log file written by modlog: glog-style text (from
+// default_prefix_data, as in LogFiles), NDJSON (json_format), logfmt
+// (logfmt_format) or BinaryFileSink files. The file is memory-mapped where
+// possible (LZ4 files are decompressed to memory), and records are parsed
+// on demand, without copies. On text formats, lines that do not start a
+// record (e.g., multi-line messages) belong to the previous record.
+MODLOG_MOD_EXPORT class LogFileView {
+ public:
+  LogFileView() = default;
+  LogFileView(const LogFileView&) = delete;
+  LogFileView& operator=(const LogFileView&) = delete;
+  ~LogFileView() { close(); }
+
+  bool open(const std::string& _path) {
+    close();
+    path = _path;
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st{};
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* p = ::mmap(nullptr, static_cast<std::size_t>(st.st_size),
+                       PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+        ::madvise(p, static_cast<std::size_t>(st.st_size), MADV_SEQUENTIAL);
+#endif
+        map = static_cast<const char*>(p);
+        map_size = static_cast<std::size_t>(st.st_size);
+      }
+    }
+    ::close(fd);
+    view = {map, map_size};
+    if (view.size() < 4 || view.substr(0, 4) != "\x04\x22\x4d\x18") {
+      detect();
+      return true;
+    }
+    close();
+#else
+    if (!std::filesystem::exists(path)) return false;
+#endif
+    owned = read_log_file(path);
+    view = owned;
+    detect();
+    return true;
+  }
+
+  void close() {
+#ifndef _WIN32
+    if (map) ::munmap(const_cast<char*>(map), map_size);
+#endif
+    map = nullptr;
+    map_size = 0;
+    owned.clear();
+    view = {};
+  }
+
+  std::string_view data() const { return view; }
+  LogFileFormat format() const { return fmt; }
+
+  // calls f(const LogRecordView&) for each record
+  template <typename F>
+  void for_each(F f) {
+    for_range(std::numeric_limits<std::int64_t>::min(),
+              std::numeric_limits<std::int64_t>::max(), f);
+  }
+
+  // calls f(const LogRecordView&) for records with time in [from, to)
+  // (on binary files, only segments of that range are decoded)
+  template <typename F>
+  void for_range(std::int64_t from, std::int64_t to, F f) {
+    if (fmt == LogFileFormat::Binary) {
+      BinaryLogReader reader;
+      if (!reader.open(path)) return;
+      for (const auto& s : reader.index()) {
+        if (s.indexed && (s.last < from || s.first >= to)) continue;
+        if (s.end > view.size()) break;
+        BinaryLogReader::decode(
+            view.substr(s.begin, s.end - s.begin), [&](const BinaryRecord& b) {
+              if (b.time < from || b.time >= to) return;
+              LogRecordView r;
+              r.level = b.level;
+              r.time = b.time;
+              r.file = b.file;
+              r.line = b.line;
+              r.msg = b.msg;
+              f(r);
+            });
+      }
+      return;
+    }
+    std::size_t p = 0;
+    while (p < view.size() && !starts_record(line_at(p))) p = next_line(p);
+    while (p < view.size()) {
+      LogRecordView r = record_from(p);
+      if (r.time >= from && r.time < to) f(r);
+      p += r.text.size();
+    }
+  }
+
+  // record containing byte 'pos' of data(), e.g., found by a search (text
+  // formats; 'text' is empty when 'pos' is before first record)
+  LogRecordView record_at(std::size_t pos) const {
+    if (fmt == LogFileFormat::Binary || pos >= view.size()) return {};
+    std::size_t p = line_start(pos);
+    while (!starts_record(line_at(p))) {
+      if (p == 0) return {};
+      p = line_start(p - 1);
+    }
+    return record_from(p);
+  }
+
+ private:
+  std::string path;
+  const char* map{nullptr};
+  std::size_t map_size{0};
+  std::string owned;  // decompressed contents (or contents, on Windows)
+  std::string_view view;
+  LogFileFormat fmt{LogFileFormat::Text};
+
+  void detect() {
+    fmt = LogFileFormat::Text;
+    if (view.substr(0, 8) == "MODLOGB1") {
+      fmt = LogFileFormat::Binary;
+      return;
+    }
+    std::size_t p = 0;
+    for (int i = 0; i < 64 && p < view.size(); i++, p = next_line(p)) {
+      auto l = line_at(p);
+      if (l.substr(0, 10) == "{\"level\":\"") {
+        fmt = LogFileFormat::Json;
+        return;
+      }
+      if (l.substr(0, 6) == "level=") {
+        fmt = LogFileFormat::Logfmt;
+        return;
+      }
+      if (text_record(l)) return;
+    }
+  }
+
+  std::size_t line_start(std::size_t pos) const {
+    auto n = view.rfind('\n', pos == 0 ? 0 : pos - 1);
+    return (n == std::string_view::npos || pos == 0) ? 0 : n + 1;
+  }
+
+  std::size_t next_line(std::size_t p) const {
+    auto n = view.find('\n', p);
+    return n == std::string_view::npos ? view.size() : n + 1;
+  }
+
+  std::string_view line_at(std::size_t p) const {
+    return view.substr(p, next_line(p) - p);
+  }
+
+  // "I20250415 14:28:33.121300 "
+  static bool text_record(std::string_view l) {
+    if (l.size() < 27 || std::string_view{"DIWEF"}.find(l[0]) ==
+                             std::string_view::npos)
+      return false;
+    for (int i : {1, 2, 3, 4, 5, 6, 7, 8, 10, 11, 13, 14, 16, 17, 19, 20, 21,
+                  22, 23, 24})
+      if (l[i] < '0' || l[i] > '9') return false;
+    return l[9] == ' ' && l[12] == ':' && l[15] == ':' && l[18] == '.' &&
+           l[25] == ' ';
+  }
+
+  bool starts_record(std::string_view l) const {
+    if (fmt == LogFileFormat::Json) return l.substr(0, 10) == "{\"level\":\"";
+    if (fmt == LogFileFormat::Logfmt) return l.substr(0, 6) == "level=";
+    return text_record(l);
+  }
+
+  static LogLevel level_of(std::string_view w) {
+    if (w == "debug") return LogLevel::Debug;
+    if (w == "warn") return LogLevel::Warning;
+    if (w == "error") return LogLevel::Error;
+    if (w == "fatal") return LogLevel::Fatal;
+    return LogLevel::Info;
+  }
+
+  // sets file and line from "file:line"
+  static void caller(std::string_view c, LogRecordView& r) {
+    auto colon = c.rfind(':');
+    if (colon == std::string_view::npos) return;
+    r.file = c.substr(0, colon);
+    std::from_chars(c.data() + colon + 1, c.data() + c.size(), r.line);
+  }
+
+  // value after 'key' in 'l', up to 'end' char
+  static std::string_view field(std::string_view l, std::string_view key,
+                                char end) {
+    auto p = l.find(key);
+    if (p == std::string_view::npos) return {};
+    p += key.size();
+    return l.substr(p, l.find(end, p) - p);
+  }
+
+  // record starting on line at 'p', with its continuation lines
+  LogRecordView record_from(std::size_t p) const {
+    LogRecordView r;
+    std::size_t e = next_line(p);
+    while (e < view.size() && !starts_record(line_at(e))) e = next_line(e);
+    r.text = view.substr(p, e - p);
+    std::string_view body = r.text;
+    if (!body.empty() && body.back() == '\n') body.remove_suffix(1);
+    std::string_view l = line_at(p);
+    if (fmt == LogFileFormat::Json) {
+      r.level = level_of(field(l, "\"level\":\"", '"'));
+      parse_wall_time(field(l, "\"timestamp\":\"", '"'), r.time);
+      caller(field(l, "\"caller\":\"", '"'), r);
+      auto m = body.find("\"msg\":\"");
+      if (m != std::string_view::npos) {
+        r.msg = body.substr(m + 7);
+        if (r.msg.size() >= 2 && r.msg.substr(r.msg.size() - 2) == "\"}")
+          r.msg.remove_suffix(2);
+      }
+    } else if (fmt == LogFileFormat::Logfmt) {
+      r.level = level_of(field(l, "level=", ' '));
+      parse_wall_time(field(l, " time=", ' '), r.time);
+      auto c = field(l, " caller=", ' ');
+      if (!c.empty() && c[0] == '"') c = field(l, " caller=\"", '"');
+      caller(c, r);
+      auto m = body.find(" msg=");
+      if (m != std::string_view::npos) r.msg = body.substr(m + 5);
+    } else {
+      r.level = l[0] == 'D'   ? LogLevel::Debug
+                : l[0] == 'W' ? LogLevel::Warning
+                : l[0] == 'E' ? LogLevel::Error
+                : l[0] == 'F' ? LogLevel::Fatal
+                              : LogLevel::Info;
+      parse_wall_time(l.substr(1, 24), r.time);
+      auto m = body.find("] ", 26);
+      if (m != std::string_view::npos) {
+        auto head = body.substr(26, m - 26);
+        auto sp = head.rfind(' ');
+        if (sp != std::string_view::npos) caller(head.substr(sp + 1), r);
+        r.msg = body.substr(m + 2);
+      }
+    }
+    return r;
+  }
+};
+
+// =======================================
+//         helper prefix function
+// =======================================
+
+MODLOG_MOD_EXPORT inline std::ostream& default_prefix_data(
+    std::ostream& os, LogLevel l, tm now_tm, std::chrono::microseconds us,
+    uintptr_t tid, std::string_view short_file, int line, bool debug) {
+  // (no locking: 'os' is the record buffer of calling thread)
+  char level = '?';
+  if (l == LogLevel::Debug)
+    level = 'D';
+  else if (l == LogLevel::Info)
+    level = 'I';
+  else if (l == LogLevel::Warning)
+    level = 'W';
+  else if (l == LogLevel::Error)
+    level = 'E';
+  else if (l == LogLevel::Fatal)
+    level = 'F';
+
+  // zero-allocation prefix: digits and cached thread label written to buf
+  char buf[64];
+  char* p = buf;
+  *p++ = level;
+  p = put_digits(p, now_tm.tm_year + 1900, 4);
+  p = put_digits(p, now_tm.tm_mon + 1, 2);
+  p = put_digits(p, now_tm.tm_mday, 2);
+  *p++ = ' ';
+  p = put_digits(p, now_tm.tm_hour, 2);
+  *p++ = ':';
+  p = put_digits(p, now_tm.tm_min, 2);
+  *p++ = ':';
+  p = put_digits(p, now_tm.tm_sec, 2);
+  *p++ = '.';
+  p = put_digits(p, us.count(), 6);
+  *p++ = ' ';
+  auto label = thread_label(tid);
+  std::memcpy(p, label.data(), label.size());
+  p += label.size();
+  if (!short_file.empty()) {
+    *p++ = ' ';
+    os.write(buf, p - buf);
+    os.write(short_file.data(), short_file.size());
+    p = buf;
+    *p++ = ':';
+    p = std::to_chars(p, buf + sizeof(buf), line).ptr;
+  }
+  *p++ = ']';
+  *p++ = ' ';
+  os.write(buf, p - buf);
+
+  return os;
+}
+
+MODLOG_MOD_EXPORT inline std::ostream& json_prefix(
+    std::ostream& os, LogLevel l, tm now_tm, std::chrono::microseconds us,
+    uintptr_t tid, std::string_view short_file, int line, bool debug) {
+  // (no locking: 'os' is the record buffer of calling thread)
+  std::string slevel;
+  if (l == LogLevel::Debug)
+    slevel = "debug";
+  else if (l == LogLevel::Info)
+    slevel = "info";
+  else if (l == LogLevel::Warning)
+    slevel = "warn";
+  else if (l == LogLevel::Error)
+    slevel = "error";
+  else if (l == LogLevel::Fatal)
+    slevel = "fatal";
+  if (debug) slevel = "debug";
+
+// #if defined(__cpp_lib_format)
+#ifdef MODLOG_USE_STD_FORMAT
+  std::string stime =
+      std::format("{:04}{:02}{:02} {:02}:{:02}:{:02}.{:06}",
+                  now_tm.tm_year + 1900, now_tm.tm_mon + 1, now_tm.tm_mday,
+                  now_tm.tm_hour, now_tm.tm_min, now_tm.tm_sec, us.count());
+#else
+  std::stringstream ss;
+  ss << std::setw(4) << std::setfill('0') << (now_tm.tm_year + 1900)
+     << std::setw(2) << std::setfill('0') << (now_tm.tm_mon + 1) << std::setw(2)
+     << std::setfill('0') << now_tm.tm_mday << ' ' << std::setw(2)
+     << std::setfill('0') << now_tm.tm_hour << ':' << std::setw(2)
+     << std::setfill('0') << now_tm.tm_min << ':' << std::setw(2)
+     << std::setfill('0') << now_tm.tm_sec << '.' << std::setw(6)
+     << std::setfill('0') << us.count();
+  std::string stime = ss.str();
+#endif
+  os << "{\"level\":\"" << slevel << "\", \"timestamp\":\"" << stime << "\", ";
+
+  if (!short_file.empty())
+    os << "\"caller\":\"" << short_file << ":" << line << "\", ";
+
+  // thread names are quoted, numeric ids are not
+  auto* t = find_thread_label(tid);
+  if (t && !t->numeric)
+    os << "\"tid\":\"" << t->view() << "\", ";
+  else
+    os << "\"tid\":" << thread_label(tid) << ", ";
+
+  os << "\"msg\":\"";
+  return os;
+}
+
+// level name on logfmt and MessagePack records (as on json_prefix)
+inline std::string_view level_word(LogLevel l, bool debug) {
+  if (l == LogLevel::Debug || debug) return "debug";
+  if (l == LogLevel::Info) return "info";
+  if (l == LogLevel::Warning) return "warn";
+  if (l == LogLevel::Error) return "error";
+  if (l == LogLevel::Fatal) return "fatal";
+  return "unknown";
+}
+
+// appends 'msg' as contents of a JSON string
+MODLOG_MOD_EXPORT inline void json_escape(std::string& out,
+                                          std::string_view msg) {
+  const char* hex = "0123456789abcdef";
+  for (char c : msg) {
+    auto u = static_cast<unsigned char>(c);
+    if (c == '"' || c == '\\') {
+      out.push_back('\\');
+      out.push_back(c);
+    } else if (c == '\n') {
+      out.append("\\n");
+    } else if (c == '\t') {
+      out.append("\\t");
+    } else if (c == '\r') {
+      out.append("\\r");
+    } else if (u < 0x20) {
+      out.append("\\u00");
+      out.push_back(hex[u >> 4]);
+      out.push_back(hex[u & 0xf]);
+    } else {
+      out.push_back(c);
+    }
+  }
+}
+
+// true if a logfmt value must be quoted (empty, or with spaces, '=', '"',
+// '\' or control chars)
+inline bool logfmt_needs_quote(std::string_view v) {
+  if (v.empty()) return true;
+  for (char c : v)
+    if (static_cast<unsigned char>(c) <= ' ' || c == '=' || c == '"' ||
+        c == '\\' || c == 0x7f)
+      return true;
+  return false;
+}
+
+// appends 'msg' as a logfmt value, quoted only when needed (quoted values
+// are escaped as JSON strings)
+MODLOG_MOD_EXPORT inline void logfmt_escape(std::string& out,
+                                            std::string_view msg) {
+  if (!logfmt_needs_quote(msg)) {
+    out.append(msg);
+    return;
+  }
+  out.push_back('"');
+  json_escape(out, msg);
+  out.push_back('"');
+}
+
+// writes a logfmt value to 'os', as logfmt_escape (always quoted on 'quote')
+inline void logfmt_put(std::ostream& os, std::string_view v,
+                       bool quote = false) {
+  thread_local std::string out;
+  out.clear();
+  if (quote && !logfmt_needs_quote(v)) {
+    out.push_back('"');
+    out.append(v);
+    out.push_back('"');
+  } else {
+    logfmt_escape(out, v);
+  }
+  os.write(out.data(), static_cast<std::streamsize>(out.size()));
+}
+
+// level=info time=2025-04-15T18:38:00.043876 thread=1234 caller=a.cpp:7 msg=
+// (numeric thread ids are written as numbers, names quoted when needed)
+MODLOG_MOD_EXPORT inline std::ostream& logfmt_prefix(
+    std::ostream& os, LogLevel l, tm now_tm, std::chrono::microseconds us,
+    uintptr_t tid, std::string_view short_file, int line, bool debug) {
+  // (no locking: 'os' is the record buffer of calling thread)
+  std::string_view level = level_word(l, debug);
+
+  // zero-allocation prefix, as default_prefix_data
+  char buf[128];
+  char* p = buf;
+  auto put = [&p](std::string_view s) {
+    std::memcpy(p, s.data(), s.size());
+    p += s.size();
+  };
+  put("level=");
+  put(level);
+  put(" time=");
+  p = put_digits(p, now_tm.tm_year + 1900, 4);
+  *p++ = '-';
+  p = put_digits(p, now_tm.tm_mon + 1, 2);
+  *p++ = '-';
+  p = put_digits(p, now_tm.tm_mday, 2);
+  *p++ = 'T';
+  p = put_digits(p, now_tm.tm_hour, 2);
+  *p++ = ':';
+  p = put_digits(p, now_tm.tm_min, 2);
+  *p++ = ':';
+  p = put_digits(p, now_tm.tm_sec, 2);
+  *p++ = '.';
+  p = put_digits(p, us.count(), 6);
+  put(" thread=");
+  auto label = thread_label(tid);
+  auto* t = find_thread_label(tid);
+  if (t && !t->numeric && logfmt_needs_quote(label)) {
+    os.write(buf, p - buf);
+    logfmt_put(os, label);
+    p = buf;
+  } else {
+    put(label);
+  }
+  if (!short_file.empty()) {
+    put(" caller=");
+    os.write(buf, p - buf);
+    p = buf;
+    if (logfmt_needs_quote(short_file)) {
+      std::string caller{short_file};  // (rare: odd file names)
+      caller.append(":").append(std::to_string(line));
+      logfmt_put(os, caller);
+    } else {
+      os.write(short_file.data(),
+               static_cast<std::streamsize>(short_file.size()));
+      *p++ = ':';
+      p = std::to_chars(p, buf + sizeof(buf), line).ptr;
+    }
+  }
+  put(" msg=");
+  os.write(buf, p - buf);
+  return os;
+}
+
+// MessagePack headers and scalars, written big-endian at 'p' (returning end
+// of output, at most 9 bytes)
+inline char* msgpack_be(char* p, std::uint64_t v, int bytes) {
+  for (int i = bytes - 1; i >= 0; i--) *p++ = static_cast<char>(v >> (8 * i));
+  return p;
+}
+
+// type byte 'tag' followed by 'v' on 'bytes' bytes
+inline char* msgpack_tag(char* p, char tag, std::uint64_t v, int bytes) {
+  *p = tag;
+  return msgpack_be(p + 1, v, bytes);
+}
+
+// header of a string with 'n' bytes
+inline char* msgpack_put_str(char* p, std::size_t n) {
+  if (n < 32) {
+    *p++ = static_cast<char>(0xa0 | n);
+    return p;
+  }
+  if (n < 256) return msgpack_tag(p, '\xd9', n, 1);
+  if (n < 65536) return msgpack_tag(p, '\xda', n, 2);
+  return msgpack_tag(p, '\xdb', n, 4);
+}
+
+inline char* msgpack_put_uint(char* p, std::uint64_t v) {
+  if (v < 128) {
+    *p++ = static_cast<char>(v);
+    return p;
+  }
+  if (v < 256) return msgpack_tag(p, '\xcc', v, 1);
+  if (v < 65536) return msgpack_tag(p, '\xcd', v, 2);
+  if (v <= 0xffffffffu) return msgpack_tag(p, '\xce', v, 4);
+  return msgpack_tag(p, '\xcf', v, 8);
+}
+
+inline char* msgpack_put_int(char* p, std::int64_t v) {
+  if (v >= 0) return msgpack_put_uint(p, static_cast<std::uint64_t>(v));
+  auto u = static_cast<std::uint64_t>(v);
+  if (v >= -32) {
+    *p++ = static_cast<char>(v);
+    return p;
+  }
+  if (v >= -128) return msgpack_tag(p, '\xd0', u, 1);
+  if (v >= -32768) return msgpack_tag(p, '\xd1', u, 2);
+  if (v >= -2147483648LL) return msgpack_tag(p, '\xd2', u, 4);
+  return msgpack_tag(p, '\xd3', u, 8);
+}
+
+inline char* msgpack_put_double(char* p, double v) {
+  std::uint64_t u;
+  std::memcpy(&u, &v, sizeof(u));
+  *p++ = '\xcb';
+  return msgpack_be(p, u, 8);
+}
+
+// MessagePack map: level (string), time (wall_time_us), tid (number, or
+// string for thread names), file and line (when known), then key "msg",
+// whose value (and typed fields) are appended by msgpack_escape
+MODLOG_MOD_EXPORT inline std::ostream& msgpack_prefix(
+    std::ostream& os, LogLevel l, tm now_tm, std::chrono::microseconds us,
+    uintptr_t tid, std::string_view short_file, int line, bool debug) {
+  // (no locking: 'os' is the record buffer of calling thread)
+  char buf[128];
+  char* p = buf;
+  auto str = [&p](std::string_view s) {
+    p = msgpack_put_str(p, s.size());
+    std::memcpy(p, s.data(), s.size());
+    p += s.size();
+  };
+  *p++ = static_cast<char>(0x80 | (short_file.empty() ? 4 : 6));
+  str("level");
+  str(level_word(l, debug));
+  str("time");
+  p = msgpack_put_int(p, wall_time_us(now_tm, us));
+  str("tid");
+  auto* t = find_thread_label(tid);
+  if (t && !t->numeric)
+    str(t->view());
+  else
+    p = msgpack_put_uint(p, tid);
+  if (!short_file.empty()) {
+    str("file");
+    p = msgpack_put_str(p, short_file.size());
+    os.write(buf, p - buf);
+    os.write(short_file.data(),
+             static_cast<std::streamsize>(short_file.size()));
+    p = buf;
+    str("line");
+    p = msgpack_put_int(p, line);
+  }
+  str("msg");
+  os.write(buf, p - buf);
+  return os;
+}
+
+// binary record, re-encoded by BinaryFileSink: mark, level + 2 (1 byte),
+// then varints wall_time_us, tid, line, file name size and file name
+// (message is appended by binary_escape)
+MODLOG_MOD_EXPORT inline std::ostream& binary_prefix(
+    std::ostream& os, LogLevel l, tm now_tm, std::chrono::microseconds us,
+    uintptr_t tid, std::string_view short_file, int line, bool debug) {
+  // (no locking: 'os' is the record buffer of calling thread)
+  if (debug) l = LogLevel::Debug;
+  char buf[48];
+  char* p = buf;
+  *p++ = binary_mark;
+  *p++ = static_cast<char>(static_cast<int>(l) + 2);
+  p = put_varint(p, static_cast<std::uint64_t>(wall_time_us(now_tm, us)));
+  p = put_varint(p, tid);
+  p = put_varint(p, static_cast<std::uint64_t>(line));
+  p = put_varint(p, short_file.size());
+  os.write(buf, p - buf);
+  os.write(short_file.data(), static_cast<std::streamsize>(short_file.size()));
+  return os;
+}
+
+MODLOG_MOD_EXPORT using FuncLogPrefix = std::function<std::ostream&(
+    std::ostream&, LogLevel, std::tm, std::chrono::microseconds,
+    std::uintptr_t, std::string_view, int, bool)>;
+
+// record metadata, captured when Log() is called
+MODLOG_MOD_EXPORT struct RecordInfo {
+  std::chrono::system_clock::time_point time;
+  std::string_view file;  // short file name
+  int line{0};
+  LogLevel level{LogLevel::Info};
+  bool debug{false};
+  std::uintptr_t tid{0};
+
+  RecordInfo() = default;
+
+  RecordInfo(LogLevel l, std::string_view path, int _line, bool _debug)
+      : time{std::chrono::system_clock::now()},
+        file{path},
+        line{_line},
+        level{l},
+        debug{_debug},
+        tid{get_tid()} {
+    auto pos = path.find_last_of("/\\");
+    if (pos != std::string_view::npos) file = path.substr(pos + 1);
+  }
+};
+
+// calls prefix function 'f' with metadata of record 'r'
+template <typename F>
+inline std::ostream& write_prefix(std::ostream& os, const F& f,
+                                  const RecordInfo& r) {
+  using namespace std::chrono;  // NOLINT
+  auto now_tm = local_tm(system_clock::to_time_t(r.time));
+  auto us = duration_cast<microseconds>(r.time.time_since_epoch()) % 1'000'000;
+  return f(os, r.level, now_tm, us, r.tid, r.file, r.line, r.debug);
+}
+
+// plain prefix function, as used by record formats
+MODLOG_MOD_EXPORT using PrefixFn = std::ostream& (*)(std::ostream&, LogLevel,
+                                                     std::tm,
+                                                     std::chrono::microseconds,
+                                                     std::uintptr_t,
+                                                     std::string_view, int,
+                                                     bool);
+
+// appends 'msg' with its size as varint (see binary_prefix)
+MODLOG_MOD_EXPORT inline void binary_escape(std::string& out,
+                                            std::string_view msg) {
+  char buf[10];
+  out.append(buf, static_cast<std::size_t>(put_varint(buf, msg.size()) - buf));
+  out.append(msg);
+}
+
+// type of a bare logfmt value: 'b' (true or false, in 'i'), 'i' (integer),
+// 'f' (floating point, in 'd') or 's' (string)
+inline char logfmt_type(std::string_view v, std::int64_t& i, double& d) {
+  if (v == "true" || v == "false") {
+    i = v == "true";
+    return 'b';
+  }
+  if (v.empty() || v.size() > 40) return 's';
+  auto r = std::from_chars(v.data(), v.data() + v.size(), i);
+  if (r.ec == std::errc{} && r.ptr == v.data() + v.size()) return 'i';
+  char buf[48];
+  std::memcpy(buf, v.data(), v.size());
+  buf[v.size()] = '\0';
+  char* end = nullptr;
+  d = std::strtod(buf, &end);
+  bool digit = (v[0] >= '0' && v[0] <= '9') ||
+               (v.size() > 1 && (v[0] == '-' || v[0] == '.') &&
+                v[1] >= '0' && v[1] <= '9');
+  return (digit && end == buf + v.size()) ? 'f' : 's';
+}
+
+// typed field written by kv() on a record, as " key=value" at [begin, end)
+// of its message: 'b' (bool, in 'i'), 'i' (integer), 'u' (unsigned, in
+// 'i'), 'f' (floating point, in 'd') or 's' (string, quoted when its value
+// starts with '"')
+struct RecordField {
+  std::size_t begin{0};
+  std::size_t key_size{0};
+  std::size_t end{0};
+  char type{'s'};
+  std::int64_t i{0};
+  double d{0};
+};
+
+// kv() fields of the record being rendered (set by LogMessage and async
+// backend, read by msgpack_escape)
+inline const std::vector<RecordField>*& rendering_fields() {
+  thread_local const std::vector<RecordField>* f = nullptr;
+  return f;
+}
+
+// string-backed stream, reused by each thread to assemble its records
+struct RecordStream : private std::streambuf, public std::ostream {
+  std::string buf;
+  std::vector<RecordField> fields;
+
+  RecordStream() : std::ostream{this} {}
+
+  void reset() {
+    buf.clear();
+    fields.clear();
+    std::ostream::clear();
+    flags(std::ios_base::skipws | std::ios_base::dec);
+    precision(6);
+    width(0);
+    fill(' ');
+  }
+
+ private:
+  int overflow(int c) override {
+    if (c != std::char_traits<char>::eof()) buf.push_back(static_cast<char>(c));
+    return c;
+  }
+
+  std::streamsize xsputn(const char* s, std::streamsize n) override {
+    buf.append(s, static_cast<std::size_t>(n));
+    return n;
+  }
+};
+
+// typed field of a record message, written as " key=value" (as logfmt),
+// e.g.: Log(Info) << "served" << kv("status", 200) << kv("path", path);
+// (strings that would read as another type are quoted, and msgpack_format
+// encodes fields as typed map entries; keys that are empty, have spaces,
+// '=' or '"', or are named as a prefix entry, are only written as text)
+MODLOG_MOD_EXPORT template <typename T>
+struct KeyValue {
+  std::string_view key;
+  const T& value;
+};
+
+MODLOG_MOD_EXPORT template <typename T>
+KeyValue<T> kv(std::string_view key, const T& value) {
+  return {key, value};
+}
+
+// true if 'key' may be a typed field (see KeyValue)
+inline bool kv_key_ok(std::string_view key) {
+  if (key.empty() || key == "level" || key == "time" || key == "tid" ||
+      key == "file" || key == "line" || key == "msg")
+    return false;
+  for (char c : key)
+    if (static_cast<unsigned char>(c) <= ' ' || c == '=' || c == '"')
+      return false;
+  return true;
+}
+
+MODLOG_MOD_EXPORT template <typename T>
+std::ostream& operator<<(std::ostream& os, const KeyValue<T>& f) {
+  // (fields are recorded only on records, not on other streams)
+  auto* rs = dynamic_cast<RecordStream*>(&os);
+  RecordField field;
+  field.begin = rs ? rs->buf.size() : 0;
+  field.key_size = f.key.size();
+  os.put(' ');
+  os.write(f.key.data(), static_cast<std::streamsize>(f.key.size()));
+  os.put('=');
+  char buf[32];
+  if constexpr (std::is_same_v<T, bool>) {
+    field.type = 'b';
+    field.i = f.value;
+    os << (f.value ? "true" : "false");
+  } else if constexpr (std::is_integral_v<T> && !std::is_same_v<T, char>) {
+    field.type = 'i';
+    field.i = static_cast<std::int64_t>(f.value);
+    if constexpr (std::is_unsigned_v<T>)
+      if (f.value > static_cast<std::uint64_t>(INT64_MAX)) field.type = 'u';
+    auto r = std::to_chars(buf, buf + sizeof(buf), f.value);
+    os.write(buf, r.ptr - buf);
+  } else if constexpr (std::is_floating_point_v<T>) {
+    // shortest of 15 or 17 digits that reads back the same value
+    auto v = static_cast<double>(f.value);
+    field.type = 'f';
+    field.d = v;
+    int n = std::snprintf(buf, sizeof(buf), "%.15g", v);
+    if (std::strtod(buf, nullptr) != v)
+      n = std::snprintf(buf, sizeof(buf), "%.17g", v);
+    os.write(buf, n);
+  } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+    std::string_view v = f.value;
+    std::int64_t i;
+    double d;
+    logfmt_put(os, v, logfmt_type(v, i, d) != 's');
+  } else {
+    std::ostringstream ss;
+    ss << f.value;
+    std::string v = ss.str();
+    std::int64_t i;
+    double d;
+    logfmt_put(os, v, logfmt_type(v, i, d) != 's');
+  }
+  if (rs && kv_key_ok(f.key)) {
+    field.end = rs->buf.size();
+    rs->fields.push_back(field);
+  }
+  return os;
+}
+
+// appends MessagePack string with contents of quoted logfmt value 'q'
+inline void msgpack_unquote(std::string& out, std::string_view q) {
+  q = q.substr(1, q.size() - 2);
+  std::size_t n = 0;
+  for (std::size_t i = 0; i < q.size(); i++, n++)
+    if (q[i] == '\\') i += (i + 1 < q.size() && q[i + 1] == 'u') ? 5 : 1;
+  char h[9];
+  out.append(h, static_cast<std::size_t>(msgpack_put_str(h, n) - h));
+  for (std::size_t i = 0; i < q.size(); i++) {
+    char c = q[i];
+    if (c == '\\' && i + 1 < q.size()) {
+      c = q[++i];
+      if (c == 'n') c = '\n';
+      else if (c == 't') c = '\t';
+      else if (c == 'r') c = '\r';
+      else if (c == 'u' && i + 4 < q.size()) {
+        unsigned u = 0;
+        std::from_chars(q.data() + i + 3, q.data() + i + 5, u, 16);
+        c = static_cast<char>(u);
+        i += 4;
+      }
+    }
+    out.push_back(c);
+  }
+}
+
+// appends value of "msg" (see msgpack_prefix): fields written by kv() on
+// the record being rendered become typed map entries (and are removed from
+// "msg"), and the map size is updated
+MODLOG_MOD_EXPORT inline void msgpack_escape(std::string& out,
+                                             std::string_view msg) {
+  // (fields are only added to a fixmap at start of 'out')
+  const std::vector<RecordField>* fields = rendering_fields();
+  bool fixmap = !out.empty() && (static_cast<unsigned char>(out[0]) & 0xf0) ==
+                                    0x80;
+  if (!fixmap || (fields && !fields->empty() && fields->back().end >
+                                                    msg.size()))
+    fields = nullptr;
+  std::size_t n = msg.size();
+  if (fields)
+    for (const auto& f : *fields) n -= f.end - f.begin;
+  char h[9];
+  out.append(h, static_cast<std::size_t>(msgpack_put_str(h, n) - h));
+  std::size_t p = 0;
+  if (fields)
+    for (const auto& f : *fields) {
+      out.append(msg.substr(p, f.begin - p));
+      p = f.end;
+    }
+  out.append(msg.substr(p));
+  if (!fields || fields->empty()) return;
+  for (const auto& f : *fields) {
+    std::string_view key = msg.substr(f.begin + 1, f.key_size);
+    std::string_view value = msg.substr(f.begin + 2 + f.key_size,
+                                        f.end - f.begin - 2 - f.key_size);
+    out.append(h, static_cast<std::size_t>(
+                      msgpack_put_str(h, key.size()) - h));
+    out.append(key);
+    char* e = h;
+    if (f.type == 'b')
+      *e++ = f.i ? '\xc3' : '\xc2';
+    else if (f.type == 'i')
+      e = msgpack_put_int(h, f.i);
+    else if (f.type == 'u')
+      e = msgpack_put_uint(h, static_cast<std::uint64_t>(f.i));
+    else if (f.type == 'f')
+      e = msgpack_put_double(h, f.d);
+    else if (!value.empty() && value[0] == '"')
+      msgpack_unquote(out, value);
+    else
+      e = msgpack_put_str(h, value.size());
+    out.append(h, static_cast<std::size_t>(e - h));
+    if (f.type == 's' && (value.empty() || value[0] != '"')) out.append(value);
+  }
+  n = (static_cast<unsigned char>(out[0]) & 0x0f) + fields->size();
+  if (n < 16) {
+    out[0] = static_cast<char>(0x80 | n);
+  } else {
+    out[0] = '\xde';
+    out.insert(1, h, static_cast<std::size_t>(msgpack_be(h, n, 2) - h));
+  }
+}
+
+// how a record is rendered for a sink: prefix, message encoding and suffix
+// (a line break ends the record, unless 'newline' is false)
+MODLOG_MOD_EXPORT struct LogFormat {
+  PrefixFn prefix{default_prefix_data};
+  std::string_view suffix{};
+  // appends encoded message (when null, message is copied as is)
+  void (*escape)(std::string&, std::string_view){nullptr};
+  bool newline{true};
+
+  bool operator==(const LogFormat& o) const {
+    return prefix == o.prefix && escape == o.escape && suffix == o.suffix &&
+           newline == o.newline;
+  }
+};
+
+MODLOG_MOD_EXPORT inline const LogFormat text_format{};
+MODLOG_MOD_EXPORT inline const LogFormat json_format{json_prefix, "\"}",
+                                                     json_escape};
+MODLOG_MOD_EXPORT inline const LogFormat logfmt_format{logfmt_prefix, "",
+                                                       logfmt_escape};
+// for BinaryFileSink
+MODLOG_MOD_EXPORT inline const LogFormat binary_format{binary_prefix, "",
+                                                       binary_escape};
+// stream of MessagePack maps, with no line breaks
+MODLOG_MOD_EXPORT inline const LogFormat msgpack_format{
+    msgpack_prefix, "", msgpack_escape, false};
+
+// format of a built-in prefix function (used as prefix of 'os')
+inline LogFormat prefix_format(PrefixFn fn) {
+  if (fn == logfmt_prefix) return logfmt_format;
+  if (fn == msgpack_prefix) return msgpack_format;
+  return LogFormat{fn};
+}
+
+// a sink of some LogConfig, receiving records with level >= 'minlog'
+// rendered with 'format' (text_format, when null)
+MODLOG_MOD_EXPORT struct SinkConfig {
+  LogSink* sink{nullptr};
+  LogLevel minlog{LogLevel::Debug};
+  const LogFormat* format{nullptr};
+};
+
+MODLOG_MOD_EXPORT class LogConfig {
+ public:
+  std::ostream* os{&std::cerr};
+  // OBS: could host a unique_ptr here, if necessary for thirdparty streams
+  // OBS 2: not necessary for the moment... if you need it, just let us know!
+  LogLevel minlog{LogLevel::Info};
+  int vlevel{0};
+  bool prefix{true};
+  NullOStream no;
+  using FuncLogPrefix = modlog::FuncLogPrefix;
+  FuncLogPrefix fprefixdata{default_prefix_data};
+  // other outputs for complete records (besides 'os', which may be null),
+  // e.g., log files. Each record is rendered once per distinct format.
+  std::vector<SinkConfig> sinks;
+  // 'os' is flushed after records at or above it (otherwise, when its
+  // buffer is full); with asynchronous logging, after a batch with one
+  LogLevel flush_level{LogLevel::Debug};
+
+  std::string getFilename(std::string_view vpath) {
+    std::string path{vpath};
+    auto pos = path.find_last_of("/\\");
+    if (pos != std::string::npos)
+      return path.substr(pos + 1);
+    else
+      return path;
+#if 0
+    return std::filesystem::path(vpath).filename().string();
+#endif
+  }
+
+  std::ostream& fprefix(std::ostream* os, LogLevel l, std::string_view path,
+                        int line, bool debug) {
+    return fprefix(os, RecordInfo{l, path, line, debug});
+  }
+
+  // =====================================
+  // use personalized prefix data function
+  // =====================================
+  std::ostream& fprefix(std::ostream* os, const RecordInfo& r) {
+    return write_prefix(*os, this->fprefixdata, r);
+  }
+};
+
+MODLOG_MOD_EXPORT inline LogConfig modlog_default;
+
+// =======================================
+//       log message (single record)
+// =======================================
+
+// per-thread record streams, one for each nesting level
+// (a Log() may happen while evaluating arguments of another Log())
+struct RecordStreamPool {
+  std::vector<std::unique_ptr<RecordStream>> streams;
+  std::size_t depth{0};
+
+  RecordStream& acquire() {
+    if (depth == streams.size())
+      streams.push_back(std::make_unique<RecordStream>());
+    auto& rs = *streams[depth++];
+    rs.reset();
+    return rs;
+  }
+
+  void release() { depth--; }
+};
+
+inline RecordStreamPool& record_streams() {
+  thread_local RecordStreamPool pool;
+  return pool;
+}
+
+// Writes a record to 'os' and to each sink accepting its level, rendering it
+// only once for each distinct format (formats are compared by value, and
+// 'os' shares a rendering when its prefix is a plain function).
+class RecordRenderer {
+ public:
+  // 'fprefixdata' is empty when no prefix is used (record is 'msg' as is);
+  // a 'record_only' record (below minlog) only goes to flight recorder
+  void write(const RecordInfo& info, const FuncLogPrefix& fprefixdata,
+             std::ostream* os, const std::vector<SinkConfig>& sinks,
+             std::string_view msg, bool record_only = false) {
+    used = 0;
+    bool prefix = static_cast<bool>(fprefixdata);
+#ifndef _WIN32
+    if (info.level >= flight_minlog.load(std::memory_order_relaxed))
+      flight_recorder.write(info.level,
+                            prefix ? render(text_format, info, msg) : msg);
+#endif
+    if (record_only) return;
+    if (os) {
+      std::string_view rec = msg;
+      if (prefix) {
+        if (auto* fn = fprefixdata.target<PrefixFn>())
+          rec = render(prefix_format(*fn), info, msg);
+        else
+          rec = compose(next_slot(), fprefixdata, LogFormat{}, info, msg);
+      }
+      os->write(rec.data(), static_cast<std::streamsize>(rec.size()));
+    }
+    for (const auto& s : sinks) {
+      if (!s.sink || info.level < s.minlog) continue;
+      std::string_view rec =
+          prefix ? render(s.format ? *s.format : text_format, info, msg) : msg;
+      s.sink->write_at(info.level, rec, info.time);
+      s.sink->written(info.level, rec.size());
+    }
+  }
+
+ private:
+  struct Slot {
+    LogFormat format;
+    bool shared{false};
+    RecordStream out;
+  };
+
+  std::string_view render(const LogFormat& f, const RecordInfo& info,
+                          std::string_view msg) {
+    for (std::size_t i = 0; i < used; i++)
+      if (slots[i]->shared && slots[i]->format == f) return slots[i]->out.buf;
+    Slot& s = next_slot();
+    s.format = f;
+    s.shared = true;
+    return compose(s, f.prefix, f, info, msg);
+  }
+
+  template <typename F>
+  static std::string_view compose(Slot& s, const F& prefix, const LogFormat& f,
+                                  const RecordInfo& info,
+                                  std::string_view msg) {
+    s.out.reset();
+    if (prefix) write_prefix(s.out, prefix, info);
+    if (!msg.empty() && msg.back() == '\n') msg.remove_suffix(1);
+    std::string& buf = s.out.buf;
+    if (f.escape)
+      f.escape(buf, msg);
+    else
+      buf.append(msg);
+    buf.append(f.suffix);
+    if (f.newline) buf.push_back('\n');
+    return buf;
+  }
+
+  Slot& next_slot() {
+    if (used == slots.size()) slots.push_back(std::make_unique<Slot>());
+    Slot& s = *slots[used++];
+    s.shared = false;
+    return s;
+  }
+
+  std::vector<std::unique_ptr<Slot>> slots;
+  std::size_t used{0};
+};
+
+// =======================================
+//      asynchronous logging backend
+// =======================================
+
+// record waiting on async queue: metadata and message are captured on
+// producer thread, while prefix is formatted and written on backend thread
+struct AsyncRecord {
+  RecordInfo info;
+  ThreadLabel thread;
+  FuncLogPrefix fprefixdata;  // empty when no prefix is used
+  std::ostream* os{nullptr};
+  std::vector<SinkConfig> sinks;  // keeps its capacity when cell is reused
+  std::string msg;
+  std::vector<RecordField> fields;  // kv() fields of 'msg'
+  bool record_only{false};
+  LogLevel flush_level{LogLevel::Debug};  // of 'os'
+};
+
+// what a producer does when its ring is full (see AsyncLogger::overflow)
+MODLOG_MOD_EXPORT enum class Overflow : int {
+  Block,       // waits for backend
+  DropNewest,  // drops the new record
+  DropOldest,  // drops oldest queued record (unless it is Error or Fatal)
+  Spin         // busy waits up to spin_limit, then drops the new record
+};
+
+// single-producer ring of records, owned by one producer thread
+// (Vyukov-style sequence numbers on each cache-line-padded cell).
+// Consumer side claims cells with CAS, so that owner thread may also drop
+// its oldest record (Overflow::DropOldest).
+class SpscRing {
+ public:
+  explicit SpscRing(std::size_t capacity) {
+    std::size_t n = round_capacity(capacity);
+    mask = n - 1;
+    cells.reset(new Cell[n]);
+    for (std::size_t i = 0; i < n; i++)
+      cells[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  ~SpscRing() {
+    take_spilled([](AsyncRecord&) {});
+  }
+
+  // fills next cell with 'fill(AsyncRecord&)'; false when full
+  template <typename F>
+  bool try_push(F&& fill) {
+    auto pos = tail.load(std::memory_order_relaxed);
+    Cell& c = cells[pos & mask];
+    if (c.seq.load(std::memory_order_acquire) != pos) return false;
+    fill(c.rec);
+    c.seq.store(pos + 1, std::memory_order_release);
+    tail.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumes oldest record with 'use(AsyncRecord&)'; false when empty
+  template <typename F>
+  bool try_pop(F&& use) {
+    auto pos = head.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& c = cells[pos & mask];
+      auto seq = c.seq.load(std::memory_order_acquire);
+      auto dif = static_cast<std::intptr_t>(seq - (pos + 1));
+      if (dif < 0) return false;
+      if (dif > 0) {
+        pos = head.load(std::memory_order_relaxed);
+      } else if (head.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_relaxed)) {
+        use(c.rec);
+        c.seq.store(pos + mask + 1, std::memory_order_release);
+        return true;
+      }
+    }
+  }
+
+  // (owner thread) drops oldest record, unless its level is >= 'keep';
+  // true if there may be room for a new record
+  bool drop_oldest(LogLevel keep) {
+    auto pos = head.load(std::memory_order_relaxed);
+    Cell& c = cells[pos & mask];
+    if (c.seq.load(std::memory_order_acquire) != pos + 1) return true;
+    // only owner thread writes cells, so reading it here is safe
+    if (c.rec.info.level >= keep) return false;
+    if (!head.compare_exchange_strong(pos, pos + 1,
+                                      std::memory_order_relaxed))
+      return true;  // consumed meanwhile
+    c.seq.store(pos + mask + 1, std::memory_order_release);
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // (owner thread) stores a record that must not be lost while ring is
+  // full, on a lock-free list drained by consumer after the ring
+  template <typename F>
+  void spill(F&& fill) {
+    auto* node = new SpillNode{};
+    fill(node->rec);
+    node->next = spill_list.load(std::memory_order_relaxed);
+    while (!spill_list.compare_exchange_weak(node->next, node,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed)) {
+    }
+  }
+
+  // while true, owner thread must not push to ring (keeps record order)
+  bool spilled() const {
+    return spill_list.load(std::memory_order_acquire) != nullptr;
+  }
+
+  // consumes spilled records, oldest first, returning how many
+  template <typename F>
+  std::size_t take_spilled(F&& use) {
+    SpillNode* node = spill_list.exchange(nullptr, std::memory_order_acquire);
+    SpillNode* prev = nullptr;
+    while (node) {
+      auto* next = node->next;
+      node->next = prev;
+      prev = node;
+      node = next;
+    }
+    std::size_t n = 0;
+    while (prev) {
+      use(prev->rec);
+      delete std::exchange(prev, prev->next);
+      n++;
+    }
+    return n;
+  }
+
+  std::size_t capacity() const { return mask + 1; }
+
+  static std::size_t round_capacity(std::size_t capacity) {
+    std::size_t n = 2;
+    while (n < capacity) n *= 2;
+    return n;
+  }
+
+  // number of records pushed/consumed (or dropped) so far
+  std::size_t pushed() const { return tail.load(std::memory_order_acquire); }
+  std::size_t popped() const { return head.load(std::memory_order_acquire); }
+
+  // set when owner thread exits, so ring is drained and recycled
+  std::atomic<bool> closed{false};
+  // records dropped by owner thread, since last report
+  std::atomic<std::size_t> dropped{0};
+
+ private:
+  struct alignas(64) Cell {
+    std::atomic<std::size_t> seq{0};
+    AsyncRecord rec;
+  };
+
+  struct SpillNode {
+    AsyncRecord rec;
+    SpillNode* next{nullptr};
+  };
+
+  alignas(64) std::atomic<std::size_t> tail{0};
+  alignas(64) std::atomic<std::size_t> head{0};
+  std::atomic<SpillNode*> spill_list{nullptr};
+  std::size_t mask{0};
+  std::unique_ptr<Cell[]> cells;
+};
+
+// Opt-in asynchronous mode (see StartAsync): Log() only captures record
+// metadata and message into a ring owned by calling thread (created on its
+// first record), while a background thread polls all rings, formats
+// prefixes and writes records to 'os' and sinks. Rings of finished threads
+// are drained and recycled for new threads.
+// When a ring is full, the Overflow policy of record level is applied
+// (Block by default), and dropped records are reported periodically by
+// the backend as "modlog: N records dropped". Error and Fatal records are
+// never dropped: unless their policy is Block, they are kept on a spill
+// list, so that the producer does not wait for the backend.
+// Records from different threads are not ordered by time among themselves.
+// Streams and sinks must outlive their queued records (see FlushLogs).
+MODLOG_MOD_EXPORT class AsyncLogger {
+ public:
+  // backend sleep when all rings are empty
+  std::chrono::microseconds idle_sleep{500};
+  // records drained from each ring before polling the next one
+  std::size_t batch{256};
+  // busy wait limit for Overflow::Spin
+  std::chrono::microseconds spin_limit{50};
+  // minimum interval between reports of dropped records
+  std::chrono::milliseconds report_interval{1000};
+
+  // policy for records of level 'l' when thread ring is full
+  // (set before StartAsync)
+  Overflow overflow(LogLevel l) const { return policies[slot(l)]; }
+  void overflow(LogLevel l, Overflow o) { policies[slot(l)] = o; }
+
+  // records dropped so far (counted by backend when reporting them)
+  std::size_t dropped() const {
+    return dropped_total.load(std::memory_order_acquire);
+  }
+
+  AsyncLogger() = default;
+  AsyncLogger(const AsyncLogger&) = delete;
+  AsyncLogger& operator=(const AsyncLogger&) = delete;
+  ~AsyncLogger() { stop(); }
+
+  // 'capacity' is the number of records on each thread ring
+  bool start(std::size_t capacity = 4096) {
+    std::lock_guard<std::mutex> lock{control};
+    if (running()) return true;
+    {
+      // free rings of a different capacity are released
+      std::lock_guard<std::mutex> rlock{registry};
+      ring_capacity = SpscRing::round_capacity(capacity);
+      std::vector<SpscRing*> stale;
+      for (auto* ring : free_rings)
+        if (ring->capacity() != ring_capacity) stale.push_back(ring);
+      auto is_stale = [&stale](SpscRing* r) {
+        return std::find(stale.begin(), stale.end(), r) != stale.end();
+      };
+      free_rings.erase(
+          std::remove_if(free_rings.begin(), free_rings.end(), is_stale),
+          free_rings.end());
+      rings.erase(std::remove_if(rings.begin(), rings.end(),
+                                 [&is_stale](const auto& r) {
+                                   return is_stale(r.get());
+                                 }),
+                  rings.end());
+    }
+    stopping.store(false, std::memory_order_relaxed);
+    crash_drain.store(0, std::memory_order_relaxed);
+    backend = std::thread{[this]() { run(); }};
+    backend_id = backend.get_id();
+    active.store(true, std::memory_order_release);
+    return true;
+  }
+
+  // drains rings and stops backend (further records are synchronous)
+  void stop() {
+    std::lock_guard<std::mutex> lock{control};
+    if (!running()) return;
+    active.store(false);
+    // a producer that saw 'active' finishes its push before the final drain
+    while (pushing.load() != 0) std::this_thread::yield();
+    stopping.store(true, std::memory_order_release);
+    backend.join();
+    // records that raced with stop
+    refresh_rings();
+    for (auto* ring : polled) drain(*ring, static_cast<std::size_t>(-1));
+    report_drops();
+    flush_touched(true);
+  }
+
+  bool running() const { return active.load(std::memory_order_acquire); }
+
+  // enqueues a record on thread ring, applying overflow policy when full;
+  // false if not running
+  bool push(const RecordInfo& info, const FuncLogPrefix& fprefixdata,
+            std::ostream* os, const std::vector<SinkConfig>& sinks,
+            std::string_view msg, bool record_only = false,
+            LogLevel flush_level = LogLevel::Debug,
+            const std::vector<RecordField>* fields = nullptr) {
+    // (counted before 'active' is checked, see stop())
+    pushing.fetch_add(1);
+    struct InFlight {
+      std::atomic<int>& n;
+      ~InFlight() { n.fetch_sub(1, std::memory_order_release); }
+    } in_flight{pushing};
+    if (!active.load()) return false;
+    SpscRing& ring = this_thread_ring();
+    const ThreadLabel& thread = this_thread_info().current;
+    auto fill = [&](AsyncRecord& r) {
+      r.info = info;
+      r.thread = thread;
+      // cells are reused, so sinks and prefix are only copied on change
+      if (!same_prefix(r.fprefixdata, fprefixdata))
+        r.fprefixdata = fprefixdata;
+      r.os = os;
+      if (!same_sinks(r.sinks, sinks))
+        r.sinks.assign(sinks.begin(), sinks.end());
+      r.msg.assign(msg.data(), msg.size());
+      if (fields)
+        r.fields.assign(fields->begin(), fields->end());
+      else
+        r.fields.clear();
+      r.record_only = record_only;
+      r.flush_level = flush_level;
+    };
+    if (!ring.spilled() && ring.try_push(fill)) return true;
+
+    auto policy = overflow(info.level);
+    if (policy == Overflow::Block) {
+      while (ring.spilled() || !ring.try_push(fill)) {
+        if (!running()) return false;
+        std::this_thread::yield();
+      }
+      return true;
+    }
+    if (info.level >= LogLevel::Error) {
+      ring.spill(fill);
+      return true;
+    }
+    if (policy == Overflow::Spin) {
+      auto limit = std::chrono::steady_clock::now() + spin_limit;
+      while (std::chrono::steady_clock::now() < limit)
+        if (!ring.spilled() && ring.try_push(fill)) return true;
+    } else if (policy == Overflow::DropOldest) {
+      if (!ring.spilled() && ring.drop_oldest(LogLevel::Error) &&
+          ring.try_push(fill))
+        return true;
+    }
+    ring.dropped.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // (crash handler) asks backend to write queued records and flush sinks,
+  // waiting up to 'limit' (only async-signal-safe calls)
+  bool drain_for_crash(std::chrono::milliseconds limit) {
+    if (!running() || std::this_thread::get_id() == backend_id) return false;
+    crash_drain.store(1, std::memory_order_release);
+#ifndef _WIN32
+    struct timespec ms{0, 1000000};
+    for (auto n = limit.count(); n > 0; n--) {
+      if (crash_drain.load(std::memory_order_acquire) == 2) return true;
+      ::nanosleep(&ms, nullptr);
+    }
+#endif
+    return crash_drain.load(std::memory_order_acquire) == 2;
+  }
+
+  // waits until records pushed before this call are written and flushed
+  void flush() {
+    if (!running()) return;
+    std::unique_lock<std::mutex> lock{mtx};
+    auto id = ++flush_requested;
+    cv.wait(lock, [&]() { return flush_done >= id || !running(); });
+  }
+
+  // same as flush(), waiting up to 'limit'; false on timeout
+  bool flush_for(std::chrono::milliseconds limit) {
+    if (!running()) return true;
+    if (std::this_thread::get_id() == backend_id) return false;
+    std::unique_lock<std::mutex> lock{mtx};
+    auto id = ++flush_requested;
+    return cv.wait_for(lock, limit,
+                       [&]() { return flush_done >= id || !running(); });
+  }
+
+ private:
+  // thread rings, one per logger: registered on first use (off the hot
+  // path) and released to backend when thread exits (rings are shared, so
+  // a logger destroyed before the thread leaves no dangling handle)
+  struct RingHandle {
+    std::size_t logger{0};
+    std::shared_ptr<SpscRing> ring;
+  };
+  struct ThreadRings {
+    std::vector<RingHandle> handles;
+    ~ThreadRings() {
+      for (auto& h : handles)
+        h.ring->closed.store(true, std::memory_order_release);
+    }
+  };
+
+  static std::size_t next_id() {
+    static std::atomic<std::size_t> n{0};
+    return n.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  // true when both are empty or the same plain function
+  static bool same_prefix(const FuncLogPrefix& a, const FuncLogPrefix& b) {
+    if (!a || !b) return !a && !b;
+    auto* fa = a.target<PrefixFn>();
+    auto* fb = b.target<PrefixFn>();
+    return fa && fb && *fa == *fb;
+  }
+
+  static bool same_sinks(const std::vector<SinkConfig>& a,
+                         const std::vector<SinkConfig>& b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                      [](const SinkConfig& x, const SinkConfig& y) {
+                        return x.sink == y.sink && x.minlog == y.minlog &&
+                               x.format == y.format;
+                      });
+  }
+
+  static int slot(LogLevel l) {
+    int i = static_cast<int>(l) + 1;
+    return i < 0 ? 0 : (i > 4 ? 4 : i);
+  }
+
+  SpscRing& this_thread_ring() {
+    thread_local ThreadRings local;
+    for (auto& h : local.handles)
+      if (h.logger == id) return *h.ring;
+    local.handles.push_back(RingHandle{id, acquire_ring()});
+    return *local.handles.back().ring;
+  }
+
+  std::shared_ptr<SpscRing> acquire_ring() {
+    std::lock_guard<std::mutex> lock{registry};
+    std::shared_ptr<SpscRing> ring;
+    if (!free_rings.empty()) {
+      SpscRing* p = free_rings.back();
+      free_rings.pop_back();
+      for (const auto& r : rings)
+        if (r.get() == p) ring = r;
+      ring->closed.store(false, std::memory_order_relaxed);
+    } else {
+      rings.push_back(std::make_shared<SpscRing>(ring_capacity));
+      ring = rings.back();
+    }
+    in_use.push_back(ring.get());
+    registry_version.fetch_add(1, std::memory_order_release);
+    return ring;
+  }
+
+  // backend copy of rings in use, refreshed when registry changes
+  void refresh_rings() {
+    auto v = registry_version.load(std::memory_order_acquire);
+    if (v == polled_version) return;
+    std::lock_guard<std::mutex> lock{registry};
+    polled = in_use;
+    polled_version = registry_version.load(std::memory_order_relaxed);
+  }
+
+  void recycle(SpscRing* ring) {
+    pending_drops += ring->dropped.exchange(0, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock{registry};
+    for (auto& p : in_use) {
+      if (p == ring) {
+        p = in_use.back();
+        in_use.pop_back();
+        break;
+      }
+    }
+    free_rings.push_back(ring);
+    registry_version.fetch_add(1, std::memory_order_release);
+  }
+
+  void run() {
+    for (;;) {
+      refresh_rings();
+      std::size_t n = 0;
+      for (auto* ring : polled) {
+        bool closed = ring->closed.load(std::memory_order_acquire);
+        n += drain(*ring, batch);
+        // all records of a finished thread were pushed before 'closed'
+        if (closed && ring->popped() == ring->pushed() && !ring->spilled())
+          recycle(ring);
+      }
+      if (crash_drain.load(std::memory_order_acquire) == 1) {
+        for (auto* ring : polled) drain(*ring, static_cast<std::size_t>(-1));
+        flush_touched(true);
+        crash_drain.store(2, std::memory_order_release);
+      }
+      if (std::chrono::steady_clock::now() >= next_report) report_drops();
+      if (n > 0) flush_touched(false);
+      check_flush();
+      if (n == 0) {
+        if (stopping.load(std::memory_order_acquire)) break;
+        std::this_thread::sleep_for(idle_sleep);
+      }
+    }
+    std::lock_guard<std::mutex> lock{mtx};
+    flush_done = flush_requested;
+    cv.notify_all();
+  }
+
+  // answers flush requests: drains what was pushed before them
+  void check_flush() {
+    std::size_t id = 0;
+    {
+      std::lock_guard<std::mutex> lock{mtx};
+      if (flush_done == flush_requested) return;
+      id = flush_requested;
+    }
+    refresh_rings();
+    for (auto* ring : polled) {
+      auto target = ring->pushed();
+      while (ring->popped() < target) drain(*ring, target - ring->popped());
+      drain(*ring, 0);
+    }
+    report_drops();
+    flush_touched(true);
+    std::lock_guard<std::mutex> lock{mtx};
+    flush_done = id;
+    cv.notify_all();
+  }
+
+  // writes up to 'max' records of 'ring', returning how many
+  // (when there are spilled records, whole ring is written before them)
+  std::size_t drain(SpscRing& ring, std::size_t max) {
+    auto use = [this](AsyncRecord& r) { write(r); };
+    std::size_t n = 0;
+    if (ring.spilled()) {
+      while (ring.try_pop(use)) n++;
+      return n + ring.take_spilled(use);
+    }
+    while (n < max && ring.try_pop(use)) n++;
+    return n;
+  }
+
+  // writes "modlog: N records dropped" on default stream and sink
+  void report_drops() {
+    next_report = std::chrono::steady_clock::now() + report_interval;
+    std::size_t n = std::exchange(pending_drops, 0);
+    for (auto* ring : polled)
+      n += ring->dropped.exchange(0, std::memory_order_relaxed);
+    if (n == 0) return;
+    dropped_total.fetch_add(n, std::memory_order_release);
+    AsyncRecord r;
+    r.info.time = std::chrono::system_clock::now();
+    r.info.level = LogLevel::Warning;
+    r.info.tid = get_tid();
+    r.thread = this_thread_info().current;
+    r.fprefixdata = modlog_default.fprefixdata;
+    r.os = modlog_default.os;
+    r.sinks = modlog_default.sinks;
+    r.msg = "modlog: " + std::to_string(n) + " records dropped";
+    write(r);
+  }
+
+  void write(AsyncRecord& r) {
+    rendering_thread() = &r.thread;
+    rendering_fields() = &r.fields;
+    renderer.write(r.info, r.fprefixdata, r.os, r.sinks, r.msg, r.record_only);
+    rendering_fields() = nullptr;
+    rendering_thread() = nullptr;
+    if (r.os && !r.record_only) {
+      touch(written_os, r.os);
+      if (r.info.level >= r.flush_level) touch(urgent_os, r.os);
+    }
+    for (const auto& s : r.sinks)
+      if (s.sink) touch(touched_sinks, s.sink);
+  }
+
+  template <typename T>
+  static void touch(std::vector<T*>& v, T* p) {
+    for (auto* q : v)
+      if (q == p) return;
+    v.push_back(p);
+  }
+
+  // flushes streams that got a record at their flush_level since last
+  // call (all streams written and sinks, if 'all')
+  void flush_touched(bool all) {
+    for (auto* os : all ? written_os : urgent_os) os->flush();
+    urgent_os.clear();
+    if (!all) return;
+    for (auto* sink : touched_sinks) sink->flush();
+    written_os.clear();
+    touched_sinks.clear();
+  }
+
+  const std::size_t id{next_id()};  // key of thread rings
+  std::atomic<bool> active{false};
+  std::atomic<int> pushing{0};  // producers inside push()
+  std::atomic<bool> stopping{false};
+  std::atomic<int> crash_drain{0};  // 1: requested, 2: done
+  std::thread backend;
+  std::thread::id backend_id;
+  std::mutex control;
+  // flush requests
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::size_t flush_requested{0};
+  std::size_t flush_done{0};
+  // ring registry
+  std::mutex registry;
+  std::size_t ring_capacity{4096};
+  std::vector<std::shared_ptr<SpscRing>> rings;
+  std::vector<SpscRing*> in_use;
+  std::vector<SpscRing*> free_rings;
+  std::atomic<std::size_t> registry_version{0};
+  // overflow policies, from Debug to Fatal
+  Overflow policies[5]{Overflow::Block, Overflow::Block, Overflow::Block,
+                       Overflow::Block, Overflow::Block};
+  std::atomic<std::size_t> dropped_total{0};
+  // backend only
+  std::vector<SpscRing*> polled;
+  std::size_t polled_version{0};
+  std::size_t pending_drops{0};
+  std::chrono::steady_clock::time_point next_report;
+  RecordRenderer renderer;
+  std::vector<std::ostream*> written_os;
+  std::vector<std::ostream*> urgent_os;
+  std::vector<LogSink*> touched_sinks;
+};
+
+MODLOG_MOD_EXPORT inline AsyncLogger async_logger;
+
+// time given to async backend to write queued records, before a Fatal
+// record terminates the process
+MODLOG_MOD_EXPORT inline std::chrono::milliseconds fatal_drain_limit{1000};
+
+// starts asynchronous logging for all Log() and VLog() calls, with
+// 'capacity' records on each thread ring
+MODLOG_MOD_EXPORT inline bool StartAsync(std::size_t capacity = 4096) {
+  return async_logger.start(capacity);
+}
+
+// drains pending records and returns to synchronous logging
+MODLOG_MOD_EXPORT inline void StopAsync() { async_logger.stop(); }
+
+// waits until pending records are written, and flushes streams and sinks
+MODLOG_MOD_EXPORT inline void FlushLogs() {
+  if (async_logger.running()) {
+    async_logger.flush();
+  } else {
+    if (modlog_default.os) modlog_default.os->flush();
+    for (const auto& s : modlog_default.sinks)
+      if (s.sink) s.sink->flush();
+  }
+}
+
+// terminates process after a Fatal record (see below)
+inline void fatal_exit();
+
+// Returned by Log() and VLog(): message is assembled on a thread-local
+// buffer, and the complete record is written to 'os' and to each sink with
+// a single write, at the end of the full expression.
+MODLOG_MOD_EXPORT class LogMessage {
+ public:
+  // disabled message (everything goes to 'no')
+  explicit LogMessage(std::ostream& no) : stream{&no} {}
+
+  // ('record_only' is a record below minlog, only for flight recorder)
+  // 'cfg' must outlive the message (its sinks are not copied)
+  LogMessage(const LogConfig& cfg, LogLevel l, std::string_view path,
+             int line, bool debug, bool _record_only = false)
+      : info{l, path, line, debug},
+        os{cfg.os},
+        flush_level{cfg.flush_level},
+        prefix{cfg.prefix},
+        record_only{_record_only} {
+    sinks = &cfg.sinks;
+    if (prefix) fprefixdata = &cfg.fprefixdata;
+    start(l);
+  }
+
+  // temporary config (e.g., returned by value from log()): its sinks and
+  // prefix are moved into the message
+  LogMessage(LogConfig&& cfg, LogLevel l, std::string_view path, int line,
+             bool debug, bool _record_only = false)
+      : info{l, path, line, debug},
+        os{cfg.os},
+        flush_level{cfg.flush_level},
+        prefix{cfg.prefix},
+        record_only{_record_only},
+        own_sinks{std::move(cfg.sinks)} {
+    if (prefix) own_prefix = std::move(cfg.fprefixdata);
+    start(l);
+  }
+
+  // (a const temporary config would not outlive the message)
+  LogMessage(const LogConfig&& cfg, LogLevel l, std::string_view path,
+             int line, bool debug, bool _record_only = false) = delete;
+
+  LogMessage(const LogMessage&) = delete;
+  LogMessage& operator=(const LogMessage&) = delete;
+
+  ~LogMessage() {
+    if (!record) return;
+    // (when backend was stopped meanwhile, record is written now)
+    if (!deferred ||
+        !async_logger.push(info, *fprefixdata, os, *sinks, record->buf,
+                           record_only,
+                           prefix ? flush_level : LogLevel::Disabled,
+                           &record->fields)) {
+      if (info.level == LogLevel::Fatal)
+        async_logger.flush_for(fatal_drain_limit);
+      write_now();
+    }
+    record_streams().release();
+    if (info.level == LogLevel::Fatal) {
+      for (const auto& s : *sinks)
+        if (s.sink) s.sink->flush();
+      fatal_exit();
+    }
+  }
+
+  // stream of the record, valid only until the end of the full expression
+  // (there is no implicit conversion, so it cannot be kept by mistake)
+  std::ostream& get() { return *stream; }
+
+  template <typename T>
+  std::ostream& operator<<(const T& v) {
+    return *stream << v;
+  }
+
+  std::ostream& operator<<(std::ostream& (*f)(std::ostream&)) {
+    return f(*stream);
+  }
+
+  std::ostream& operator<<(std::ios_base& (*f)(std::ios_base&)) {
+    f(*stream);
+    return *stream;
+  }
+
+ private:
+  void start(LogLevel l) {
+    record = &record_streams().acquire();
+    stream = record;
+    // Fatal is never deferred, since it terminates right after
+    deferred = (l < LogLevel::Fatal) && async_logger.running();
+  }
+
+  void write_now() {
+    // a sink could log while a record is written, with its own renderer
+    thread_local RecordRenderer renderer;
+    thread_local bool busy = false;
+    auto* fields = std::exchange(rendering_fields(), &record->fields);
+    if (busy) {
+      RecordRenderer nested;
+      nested.write(info, *fprefixdata, os, *sinks, record->buf, record_only);
+    } else {
+      busy = true;
+      renderer.write(info, *fprefixdata, os, *sinks, record->buf,
+                     record_only);
+      busy = false;
+    }
+    rendering_fields() = fields;
+    if (prefix && os && !record_only && info.level >= flush_level)
+      os->flush();
+  }
+
+  std::ostream* stream{nullptr};
+  RecordStream* record{nullptr};
+  RecordInfo info;
+  std::ostream* os{nullptr};
+  LogLevel flush_level{LogLevel::Debug};
+  bool prefix{false};
+  bool record_only{false};
+  bool deferred{false};
+  FuncLogPrefix own_prefix;  // empty when no prefix is used
+  std::vector<SinkConfig> own_sinks;
+  const FuncLogPrefix* fprefixdata{&own_prefix};
+  const std::vector<SinkConfig>* sinks{&own_sinks};
+};
+
+// =======================================
+//             handling Fatal
+// =======================================
+
+inline std::atomic<bool> fatal_exiting{false};
+
+// Ends process after a Fatal record: only first thread proceeds (others
+// wait for it), a raw backtrace is written to default sinks, which are
+// flushed, and only then stacktrace is symbolized on stderr.
+inline void fatal_exit() {
+  static std::atomic<std::thread::id> owner{};
+  bool expected = false;
+  if (!fatal_exiting.compare_exchange_strong(expected, true)) {
+    if (owner.load() == std::this_thread::get_id()) std::abort();
+    for (;;) std::this_thread::sleep_for(std::chrono::seconds{1});
+  }
+  owner.store(std::this_thread::get_id());
+#ifdef MODLOG_HAS_EXECINFO
+  void* frames[64];
+  int n = ::backtrace(frames, 64);
+  std::string trace = "*** Check failure stack trace: ***\n";
+  char addr[24];
+  for (int i = 0; i < n; i++) {
+    auto r = std::to_chars(addr, addr + sizeof(addr),
+                           reinterpret_cast<std::uintptr_t>(frames[i]), 16);
+    trace.append("    @ 0x").append(addr, r.ptr).push_back('\n');
+  }
+  for (const auto& s : modlog_default.sinks)
+    if (s.sink) s.sink->write(LogLevel::Fatal, trace);
+#endif
+  for (const auto& s : modlog_default.sinks)
+    if (s.sink) s.sink->flush();
+  log_files.flush();
+  if (modlog_default.os) modlog_default.os->flush();
+#if MODLOG_STACKTRACE && defined(__cpp_lib_stacktrace)
+  std::cerr << std::stacktrace::current() << std::endl;
+#elif defined(MODLOG_HAS_EXECINFO)
+  ::backtrace_symbols_fd(frames, n, 2);
+#else
+  std::cerr << "WARNING: stacktrace unavailable, must #include <stacktrace> "
+               "and -lstdc++exp"
+            << std::endl;
+#endif
+  std::terminate();
+}
+
+// modlog::fatal << "message" << std::endl; writes a Fatal record (without
+// caller) to default stream and sinks when a line ends, and terminates.
+// Each thread has its own buffer.
+struct FatalStream {
+  template <typename T>
+  std::ostream& operator<<(const T& v) {
+    return stream() << v;
+  }
+
+  std::ostream& operator<<(std::ostream& (*f)(std::ostream&)) {
+    return f(stream());
+  }
+
+  std::ostream& operator<<(std::ios_base& (*f)(std::ios_base&)) {
+    f(stream());
+    return stream();
+  }
+
+  operator std::ostream&() { return stream(); }
+
+ private:
+  struct Buffer : private std::streambuf, public std::ostream {
+    std::string text;
+
+    Buffer() : std::ostream{this} {}
+
+    int overflow(int c) override {
+      if (c == '\n')
+        LogMessage{modlog_default, LogLevel::Fatal, {}, 0, false} << text;
+      else if (c != std::char_traits<char>::eof())
+        text.push_back(static_cast<char>(c));
+      return c;
+    }
+  };
+
+  static std::ostream& stream() {
+    thread_local Buffer b;
+    return b;
+  }
+};
+
+MODLOG_MOD_EXPORT inline FatalStream fatal;
+
+// #ifdef __cpp_concepts
+#ifdef MODLOG_USE_STD_CONCEPTS
+template <typename Self>
+concept Loggable = requires(Self obj) {
+  { obj.stream() } -> std::same_as<std::ostream&>;
+  { obj.log() } -> std::same_as<LogLevel>;
+  { obj.prefix() } -> std::same_as<bool>;
+} || requires(Self obj) {
+  // (by value, or by reference to a config used in place)
+  requires std::same_as<std::remove_cvref_t<decltype(obj.log())>, LogConfig>;
+};
+#else
+#define Loggable typename
+#endif
+
+// ==============================
+// logs with global configuration
+// ==============================
+
+MODLOG_MOD_EXPORT inline LogMessage Log(
+    LogLevel sev = LogLevel::Info,
+    // const std::source_location location = std::source_location::current()) {
+    const my_source_location location = MY_SOURCE_LOCATION()) {
+  if (modlog_default.minlog == LogLevel::Disabled)
+    return LogMessage{modlog_default.no};
+  bool below = sev < modlog_default.minlog;
+#ifdef NDEBUG
+  // (release) Debug records only reach flight recorder
+  below = below || sev < LogLevel::Info;
+#endif
+  if (below) {
+    if (sev < flight_minlog.load(std::memory_order_relaxed))
+      return LogMessage{modlog_default.no};
+    return LogMessage{modlog_default, sev, location.file_name(),
+                      static_cast<int>(location.line()), false, true};
+  }
+  return LogMessage{modlog_default, sev, location.file_name(),
+                    static_cast<int>(location.line()), false};
+}
+
+// ===============================
+// vlogs with global configuration
+// ===============================
+
+MODLOG_MOD_EXPORT inline LogMessage VLog(
+    int vlevel,
+    // const std::source_location location = std::source_location::current()) {
+    const my_source_location location = MY_SOURCE_LOCATION()) {
+  if (modlog_default.minlog == LogLevel::Disabled)
+    return LogMessage{modlog_default.no};
+  bool below = (LogLevel::Info < modlog_default.minlog) ||
+               (vlevel > modlog_default.vlevel);
+#ifdef NDEBUG
+  // (release) verbose records only reach flight recorder
+  below = below || vlevel > 0;
+#endif
+  if (below) {
+    // verbose records are kept by flight recorder as Debug ones
+    if (LogLevel::Debug < flight_minlog.load(std::memory_order_relaxed))
+      return LogMessage{modlog_default.no};
+    return LogMessage{modlog_default, LogLevel::Info, location.file_name(),
+                      static_cast<int>(location.line()), true, true};
+  }
+  return LogMessage{modlog_default, LogLevel::Info, location.file_name(),
+                    static_cast<int>(location.line()), true};
+}
+
+// =======================================
+// logs with object-specific configuration
+// =======================================
+
+/*
+// No "Default" logging for objects
+MODLOG_MOD_EXPORT template <Loggable LogObj>
+inline std::ostream& Log(
+    LogObj* lo,
+    // const std::source_location location = std::source_location::current()) {
+    const my_source_location location = MY_SOURCE_LOCATION()) {
+  return (LogLevel::Info < lo->log().minlog)
+             ? modlog_default.no
+             : (lo->log().prefix
+                    ? modlog_default.fprefix(lo->log().os, LogLevel::Info,
+                                             location.file_name(),
+                                             location.line(), false)
+                    : *lo->log().os);
+}
+*/
+
+MODLOG_MOD_EXPORT template <Loggable LogObj>
+inline LogMessage Log(
+    LogLevel sev, LogObj* lo,
+    // const std::source_location location = std::source_location::current()) {
+    const my_source_location location = MY_SOURCE_LOCATION()) {
+  // (a config returned by reference is used in place, otherwise moved)
+  auto&& cfg = lo->log();
+  using Cfg = decltype(cfg);
+  if (cfg.minlog == LogLevel::Disabled) return LogMessage{modlog_default.no};
+  bool below = sev < cfg.minlog;
+#ifdef NDEBUG
+  // (release) Debug records only reach flight recorder
+  below = below || sev < LogLevel::Info;
+#endif
+  if (below) {
+    if (sev < flight_minlog.load(std::memory_order_relaxed))
+      return LogMessage{modlog_default.no};
+    return LogMessage{std::forward<Cfg>(cfg), sev, location.file_name(),
+                      static_cast<int>(location.line()), false, true};
+  }
+  return LogMessage{std::forward<Cfg>(cfg), sev, location.file_name(),
+                    static_cast<int>(location.line()), false};
+}
+
+// ================================
+//    support for file logging
+// ================================
+
+// starts glog-style file logging for global Log()/VLog() (see LogFiles),
+// on 'log_dir' (or $TMPDIR, $TMP, $TEMP and /tmp, when empty)
+MODLOG_MOD_EXPORT inline bool StartLogs(std::string_view app_name,
+                                        std::string_view log_dir = {}) {
+  if (!log_files.open(app_name, log_dir)) {
+    Log(LogLevel::Warning) << "modlog could not create log files on '"
+                           << log_dir << "'!";
+    return false;
+  }
+  auto& sinks = modlog_default.sinks;
+  for (const auto& s : sinks)
+    if (s.sink == &log_files) return true;
+  sinks.push_back({&log_files, LogLevel::Debug, &text_format});
+  return true;
+}
+
+// flushes and closes default sinks (see LogSink::close), detaching log files
+MODLOG_MOD_EXPORT inline void StopLogs() {
+  async_logger.flush();
+  auto& sinks = modlog_default.sinks;
+  for (const auto& s : sinks)
+    if (s.sink && s.sink != &log_files) s.sink->close();
+  sinks.erase(std::remove_if(sinks.begin(), sinks.end(),
+                             [](const SinkConfig& s) {
+                               return s.sink == &log_files;
+                             }),
+              sinks.end());
+  log_files.close();
+  if (modlog_default.os) modlog_default.os->flush();
+}
+
+#ifndef _WIN32
+// starts crash flight recorder on 'path', keeping last 'size' bytes of
+// records with level >= 'minlog', even when below LogConfig::minlog
+// (recover them with FlightRecorder::recover() or tools/modlog_flight; a
+// ring left on 'path' by a previous run is moved to <path>.prev)
+MODLOG_MOD_EXPORT inline bool StartFlightRecorder(
+    const std::string& path, std::size_t size = 8 * 1024 * 1024,
+    LogLevel minlog = LogLevel::Debug) {
+  if (!flight_recorder.open(path, size)) return false;
+  flight_minlog.store(minlog);
+  return true;
+}
+
+// stops flight recorder (its file is kept)
+MODLOG_MOD_EXPORT inline void StopFlightRecorder() {
+  async_logger.flush();
+  flight_minlog.store(LogLevel::Disabled);
+  flight_recorder.close();
+}
+#endif
+
+// ================================
+//   crash handler (signal-safe)
+// ================================
+
+#ifndef _WIN32
+// record text built on a fixed buffer (async-signal-safe)
+struct CrashText {
+  char buf[4096];
+  std::size_t n{0};
+
+  void put(std::string_view s) {
+    for (char c : s)
+      if (n < sizeof(buf)) buf[n++] = c;
+  }
+
+  void put_dec(std::uint64_t v, int width = 1) {
+    char t[20];
+    int i = 0;
+    do {
+      t[i++] = static_cast<char>('0' + v % 10);
+      v /= 10;
+    } while (v > 0 || i < width);
+    while (i > 0) put(std::string_view{&t[--i], 1});
+  }
+
+  void put_hex(std::uintptr_t v) {
+    const char* hex = "0123456789abcdef";
+    char t[2 * sizeof(v)];
+    int i = 0;
+    do {
+      t[i++] = hex[v & 0xf];
+      v >>= 4;
+    } while (v > 0);
+    put("0x");
+    while (i > 0) put(std::string_view{&t[--i], 1});
+  }
+
+  std::string_view view() const { return {buf, n}; }
+};
+
+// time given to async backend to write queued records, on a crash
+MODLOG_MOD_EXPORT inline std::chrono::milliseconds crash_drain_limit{1000};
+
+inline const char* crash_signal_name(int sig) {
+  switch (sig) {
+    case SIGSEGV:
+      return "SIGSEGV";
+    case SIGBUS:
+      return "SIGBUS";
+    case SIGFPE:
+      return "SIGFPE";
+    case SIGABRT:
+      return "SIGABRT";
+    default:
+      return "signal";
+  }
+}
+
+// Writes queued records (async backend), then a fatal record with a raw
+// backtrace (symbolize it offline, e.g., addr2line) to stderr and default
+// sinks, and re-raises signal (handler was reset by SA_RESETHAND).
+inline void crash_handler(int sig, siginfo_t* si, void*) {
+  // first crashing thread reports, others wait for it to end the process
+  static std::atomic<std::uintptr_t> owner{0};
+  std::uintptr_t me = get_kernel_tid();
+  std::uintptr_t expected = 0;
+  if (!owner.compare_exchange_strong(expected, me) ||
+      fatal_exiting.load()) {
+    if (expected != me && expected != 0)
+      for (;;) ::pause();
+    ::raise(sig);  // crashed while reporting, or Fatal was reported
+    return;
+  }
+  async_logger.drain_for_crash(crash_drain_limit);
+
+  CrashText t;
+  struct timespec ts{};
+  ::clock_gettime(CLOCK_REALTIME, &ts);
+  t.put("*** ");
+  t.put(crash_signal_name(sig));
+  t.put(" (@");
+  t.put_hex(reinterpret_cast<std::uintptr_t>(si ? si->si_addr : nullptr));
+  t.put(") received by PID ");
+  t.put_dec(static_cast<std::uint64_t>(::getpid()));
+  t.put(" (TID ");
+  t.put_dec(me);
+  t.put(") at ");
+  t.put_dec(static_cast<std::uint64_t>(ts.tv_sec));
+  t.put(".");
+  t.put_dec(static_cast<std::uint64_t>(ts.tv_nsec / 1000), 6);
+  t.put(" (unix time); stack trace: ***\n");
+#ifdef MODLOG_HAS_EXECINFO
+  void* frames[64];
+  int n = ::backtrace(frames, 64);
+  for (int i = 0; i < n; i++) {
+    t.put("    @ ");
+    t.put_hex(reinterpret_cast<std::uintptr_t>(frames[i]));
+    t.put("\n");
+  }
+#endif
+  file_write_all(2, t.buf, t.n);
+  for (const auto& s : modlog_default.sinks)
+    if (s.sink) s.sink->crash_write(t.view());
+  if (flight_minlog.load(std::memory_order_relaxed) != LogLevel::Disabled)
+    flight_recorder.crash_write(t.view());
+  ::raise(sig);
+}
+
+// installs crash_handler for SIGSEGV, SIGBUS, SIGFPE and SIGABRT (an
+// alternate stack for the calling thread allows reporting stack overflows)
+MODLOG_MOD_EXPORT inline bool InstallCrashHandler() {
+#ifdef MODLOG_HAS_EXECINFO
+  // loads unwinder now, since it may allocate on first use
+  void* frame[1];
+  ::backtrace(frame, 1);
+#endif
+  static std::unique_ptr<char[]> alt_stack;
+  if (!alt_stack) {
+    std::size_t size = std::max<std::size_t>(64 * 1024, SIGSTKSZ);
+    alt_stack.reset(new char[size]);
+    stack_t ss{};
+    ss.ss_sp = alt_stack.get();
+    ss.ss_size = size;
+    ::sigaltstack(&ss, nullptr);
+  }
+  struct sigaction sa{};
+  sa.sa_sigaction = crash_handler;
+  sa.sa_flags = SA_SIGINFO | SA_RESETHAND | SA_ONSTACK;
+  sigemptyset(&sa.sa_mask);
+  bool ok = true;
+  for (int sig : {SIGSEGV, SIGBUS, SIGFPE, SIGABRT})
+    ok = (::sigaction(sig, &sa, nullptr) == 0) && ok;
+  return ok;
+}
+#endif
+
+// ================================
+//     semantic stream - utils
+// ================================
+
+// Stream for semantic output (e.g., json records on a LogConfig::os).
+// With an ostream, text is forwarded to it in bulk. Otherwise, text is
+// captured on one of two buffers: appends reserve room on active buffer
+// with an atomic counter and copy into it (only growing it takes a lock),
+// and dump() switches to other buffer, handing over captured text without
+// copying it. Appends (append(), or a single write() per record, as
+// LogMessage does) may come from several threads.
+struct SemStream : private std::streambuf, public std::ostream {
+ public:
+  // never null: this stream itself while capturing (text written to *os is
+  // captured too), otherwise the stream text is forwarded to
+  std::ostream* os{this};
 
   explicit SemStream(std::ostream& _os) : std::ostream{this}, os{&_os} {}
 
-  SemStream() : std::ostream{this}, os{&oss} {}
+  SemStream() : std::ostream{this} { bufs[0].data.resize(initial_capacity); }
+
+  void setStream(std::ostream& _os) { os = &_os; }
+
+  bool capturing() const { return os == this; }
+
+  void append(std::string_view s) {
+    if (!capturing()) {
+      os->write(s.data(), static_cast<std::streamsize>(s.size()));
+      return;
+    }
+    for (;;) {
+      int i = active.load();
+      Buffer& b = bufs[i];
+      auto u = b.users.fetch_add(1);
+      if ((u & frozen) || active.load() != i) {
+        // being grown or dumped: waits for it
+        b.users.fetch_sub(1);
+        std::lock_guard<std::mutex> lock{mtx};
+        continue;
+      }
+      std::size_t cap = b.data.size();
+      std::size_t off = b.reserved.fetch_add(s.size());
+      if (off + s.size() <= cap) {
+        std::memcpy(&b.data[off], s.data(), s.size());
+        b.users.fetch_sub(1);
+        return;
+      }
+      // crossing capacity: where text ends, for grow()
+      if (off <= cap) b.end.store(off);
+      b.users.fetch_sub(1);
+      grow(i, s.size());
+    }
+  }
+
+  // captured text, and capture starts again (on other buffer); empty when
+  // text is forwarded
+  std::string dump() {
+    std::lock_guard<std::mutex> lock{mtx};
+    int i = active.load();
+    Buffer& next = bufs[1 - i];
+    next.reserved = 0;
+    next.end = npos;
+    if (next.data.size() < initial_capacity) next.data.resize(initial_capacity);
+    active.store(1 - i);
+    Buffer& b = bufs[i];
+    std::size_t used = wait_writers(b);
+    std::string out = std::move(b.data);
+    b.data = std::string{};
+    b.reserved = 0;
+    b.end = npos;
+    b.users.fetch_and(~frozen);
+    out.resize(used);
+    clear();
+    return out;
+  }
 
  private:
+  struct Buffer {
+    std::string data;  // size() is capacity
+    std::atomic<std::size_t> reserved{0};
+    std::atomic<std::size_t> end{npos};
+    std::atomic<std::uint32_t> users{0};  // appends in flight (and frozen)
+  };
+
+  static constexpr std::size_t initial_capacity = 64 * 1024;
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+  static constexpr std::uint32_t frozen = 0x80000000U;
+
+  // (locked) freezes 'b' and waits for appends on it, returning its length
+  static std::size_t wait_writers(Buffer& b) {
+    b.users.fetch_or(frozen);
+    while ((b.users.load() & ~frozen) != 0) std::this_thread::yield();
+    std::size_t r = b.reserved.load();
+    return r <= b.data.size() ? r : b.end.load();
+  }
+
+  void grow(int i, std::size_t n) {
+    std::lock_guard<std::mutex> lock{mtx};
+    Buffer& b = bufs[i];
+    if (active.load() != i || b.reserved.load() <= b.data.size()) return;
+    std::size_t used = wait_writers(b);
+    b.data.resize(std::max(2 * b.data.size(), used + 2 * n));
+    b.reserved = used;
+    b.end = npos;
+    b.users.fetch_and(~frozen);
+  }
+
   int overflow(int c) override {
-    (*os).put(c);
+    if (c != std::streambuf::traits_type::eof()) {
+      char ch = static_cast<char>(c);
+      append({&ch, 1});
+    }
     return 0;
   }
 
+  std::streamsize xsputn(const char* s, std::streamsize n) override {
+    append({s, static_cast<std::size_t>(n)});
+    return n;
+  }
+
+  Buffer bufs[2];
+  std::atomic<int> active{0};
+  std::mutex mtx;  // growing and dumping
+};
+
+// Append-only store of records of one semantic channel (e.g., "json",
+// "metrics" or "trace"), also a LogSink (see SinkConfig). Records are kept
+// on chunks (64KiB, doubling up to 4MiB), each one with an arena of bytes
+// and an index of records. An append reserves its index slot and bytes
+// with a single atomic counter, copies the record and then publishes its
+// slot, so appends never lock. Readers see records in order, up to the
+// first one still being copied.
+MODLOG_MOD_EXPORT class SemChannel : public LogSink {
  public:
-  void setStream(std::ostream& _os) { os = &_os; }
+  SemChannel() { head = tail = new Chunk{min_chunk}; }
+  SemChannel(const SemChannel&) = delete;
+  SemChannel& operator=(const SemChannel&) = delete;
+  ~SemChannel() override { free_chunks(); }
 
-  std::string dump() {
-    std::string dump{oss.str()};
-    oss.str(std::string{});
-    os->clear();
-    return dump;
+  void append(LogLevel l, std::string_view record) {
+    std::size_t n = std::min(record.size(), max_record);
+    for (;;) {
+      Chunk* c = tail.load(std::memory_order_acquire);
+      std::uint64_t r =
+          c->reserved.fetch_add((std::uint64_t{1} << 40) + n,
+                                std::memory_order_relaxed);
+      std::size_t slot = static_cast<std::size_t>(r >> 40);
+      std::size_t off = static_cast<std::size_t>(r & bytes_mask);
+      if (slot < c->slots && off + n <= c->capacity) {
+        std::memcpy(c->data.get() + off, record.data(), n);
+        auto level = static_cast<std::uint64_t>(static_cast<int>(l) + 2);
+        c->index[slot].store(std::uint64_t{off} << 32 | (n + 1) << 4 | level,
+                             std::memory_order_release);
+        return;
+      }
+      // chunk is full: rest of its slots are unused
+      if (slot < c->slots)
+        c->index[slot].store(dead, std::memory_order_release);
+      extend(c, n);
+    }
+  }
+
+  void write(LogLevel l, std::string_view record) override {
+    append(l, record);
+  }
+
+  // calls fn(level, record) for each record, in order
+  template <typename F>
+  void for_each(F&& fn) const {
+    for (Chunk* c = head; c; c = c->next.load(std::memory_order_acquire)) {
+      std::size_t n = std::min(
+          static_cast<std::size_t>(
+              c->reserved.load(std::memory_order_acquire) >> 40),
+          c->slots);
+      for (std::size_t i = 0; i < n; i++) {
+        std::uint64_t v = c->index[i].load(std::memory_order_acquire);
+        if (v == 0) return;  // still being copied
+        if (v == dead) break;
+        auto level = static_cast<LogLevel>(static_cast<int>(v & 15) - 2);
+        fn(level, std::string_view{c->data.get() + (v >> 32),
+                                   static_cast<std::size_t>(
+                                       ((v & 0xFFFFFFFFU) >> 4) - 1)});
+      }
+    }
+  }
+
+  // records for which pred(level, record) is true (views into channel)
+  template <typename P>
+  std::vector<std::string_view> select(P&& pred) const {
+    std::vector<std::string_view> v;
+    for_each([&](LogLevel l, std::string_view r) {
+      if (pred(l, r)) v.push_back(r);
+    });
+    return v;
+  }
+
+  // writes records with level >= minlog to 'sink', returning how many
+  std::size_t export_to(LogSink& sink,
+                        LogLevel minlog = LogLevel::Debug) const {
+    std::size_t count = 0;
+    for_each([&](LogLevel l, std::string_view r) {
+      if (l < minlog) return;
+      sink.write(l, r);
+      count++;
+    });
+    sink.flush();
+    return count;
+  }
+
+  std::size_t size() const {
+    std::size_t count = 0;
+    for_each([&count](LogLevel, std::string_view) { count++; });
+    return count;
+  }
+
+  // removes all records (not concurrently with appends)
+  void clear() {
+    free_chunks();
+    head = new Chunk{min_chunk};
+    tail.store(head, std::memory_order_release);
+  }
+
+ private:
+  struct Chunk {
+    explicit Chunk(std::size_t bytes)
+        : data{new char[bytes]},
+          index{new std::atomic<std::uint64_t>[bytes / 16 + 1]()},
+          capacity{bytes},
+          slots{bytes / 16 + 1} {}
+
+    std::unique_ptr<char[]> data;
+    // per slot: offset (32 bits), length + 1 (28 bits), level + 2 (4 bits)
+    std::unique_ptr<std::atomic<std::uint64_t>[]> index;
+    std::size_t capacity;
+    std::size_t slots;
+    // slots (high 24 bits) and bytes (low 40 bits) reserved so far
+    std::atomic<std::uint64_t> reserved{0};
+    std::atomic<Chunk*> next{nullptr};
+  };
+
+  static constexpr std::size_t min_chunk = 64 * 1024;
+  static constexpr std::size_t max_chunk = 4 * 1024 * 1024;
+  static constexpr std::size_t max_record = (std::size_t{1} << 27) - 1;
+  static constexpr std::uint64_t bytes_mask = (std::uint64_t{1} << 40) - 1;
+  static constexpr std::uint64_t dead = ~std::uint64_t{0};
+
+  // links a chunk (with room for 'n' bytes) after 'c', and moves tail to it
+  void extend(Chunk* c, std::size_t n) {
+    Chunk* next = c->next.load(std::memory_order_acquire);
+    if (!next) {
+      auto* fresh =
+          new Chunk{std::max(std::min(2 * c->capacity, max_chunk), n)};
+      if (c->next.compare_exchange_strong(next, fresh,
+                                          std::memory_order_acq_rel))
+        next = fresh;
+      else
+        delete fresh;
+    }
+    tail.compare_exchange_strong(c, next, std::memory_order_acq_rel);
+  }
+
+  void free_chunks() {
+    for (Chunk* c = head; c;) {
+      Chunk* next = c->next.load(std::memory_order_relaxed);
+      delete c;
+      c = next;
+    }
+    head = nullptr;
+  }
+
+  Chunk* head{nullptr};
+  std::atomic<Chunk*> tail{nullptr};
+};
+
+// Registry of semantic channels by tag: a channel is created on first use
+// (without locking), and lives as long as the registry.
+MODLOG_MOD_EXPORT class SemChannels {
+ public:
+  SemChannels() = default;
+  SemChannels(const SemChannels&) = delete;
+  SemChannels& operator=(const SemChannels&) = delete;
+  ~SemChannels() {
+    for (Node* n = head.load(); n;) {
+      Node* next = n->next;
+      delete n;
+      n = next;
+    }
+  }
+
+  SemChannel& channel(std::string_view tag) {
+    Node* h = head.load(std::memory_order_acquire);
+    for (;;) {
+      for (Node* n = h; n; n = n->next)
+        if (n->tag == tag) return n->channel;
+      auto* fresh = new Node{tag, h};
+      if (head.compare_exchange_strong(h, fresh, std::memory_order_acq_rel))
+        return fresh->channel;
+      delete fresh;  // 'h' was updated: looks again
+    }
   }
+
+  // channel of 'tag', if it exists
+  SemChannel* find(std::string_view tag) {
+    for (Node* n = head.load(std::memory_order_acquire); n; n = n->next)
+      if (n->tag == tag) return &n->channel;
+    return nullptr;
+  }
+
+  // calls fn(tag, channel) for each channel (newest first)
+  template <typename F>
+  void for_each(F&& fn) {
+    for (Node* n = head.load(std::memory_order_acquire); n; n = n->next)
+      fn(std::string_view{n->tag}, n->channel);
+  }
+
+ private:
+  struct Node {
+    Node(std::string_view _tag, Node* _next) : tag{_tag}, next{_next} {}
+    std::string tag;
+    SemChannel channel;
+    Node* next;
+  };
+
+  std::atomic<Node*> head{nullptr};
 };
 
+MODLOG_MOD_EXPORT inline SemChannels sem_channels;
+
 }  // namespace modlog
 
 #endif
@@ -2,9 +2,32 @@
 // Copyright (C) 2025 - modlog library - https://github.com/igormcoelho/modlog
 
 module;
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <poll.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stdint.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
+#if __has_include(<execinfo.h>)
+#include <execinfo.h>
+#define MODLOG_HAS_EXECINFO 1
+#endif
+#if defined(__linux__)
+#include <sys/syscall.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define MODLOG_HAS_IO_URING 1
+#endif
+#endif
 export module modlog;
 export import std;
 
@@ -2,11 +2,18 @@
 // Copyright (C) 2025 - modlog
 // https://github.com/igormcoelho/modlog
 
+#include <algorithm>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
+#ifndef _WIN32
+#include <sys/wait.h>
+#endif
 //
 #include <boost/ut.hpp>
 #include <modlog/modlog.hpp>
@@ -56,7 +63,7 @@ int main(int argc, char** argv) {
   t.logdata = &ss;
 
   Log(Warning, &t) << "testing" << std::endl;
-  // line 58 must be above!
+  // line 65 must be above!
 
   std::string sout = ss.str();
   // std::cout << "sout: '" << sout << "'" << std::endl;
@@ -70,10 +77,1265 @@ int main(int argc, char** argv) {
     expect(words.size() == 3_i);
     expect(words[0] == std::string{"level=warn"});
 #ifndef __APPLE__
-    expect(words[1] == std::string{"caller=all_ut.cpp:58"});
+    expect(words[1] == std::string{"caller=all_ut.cpp:65"});
 #endif
     expect(words[2] == std::string{"msg=testing"});
   };
 
+  "ThreadIdMode"_test = [] {
+    std::stringstream ss2;
+    modlog::thread_id_mode = modlog::ThreadIdMode::Index;
+    auto index = modlog::get_tid();
+    expect(modlog::thread_label() == std::to_string(index));
+    modlog::set_thread_name("io-3");
+    expect(modlog::thread_label() == std::to_string(index));
+    modlog::thread_id_mode = modlog::ThreadIdMode::Name;
+    expect(modlog::thread_label() == std::string{"io-3"});
+    std::tm tm{};
+    modlog::default_prefix_data(ss2, Info, tm, std::chrono::microseconds{0},
+                                modlog::get_tid(), "a.cpp", 7, false);
+    expect(ss2.str() ==
+           std::string{"I19000100 00:00:00.000000 io-3 a.cpp:7] "});
+    modlog::thread_id_mode = modlog::ThreadIdMode::Kernel;
+  };
+
+  "LogfmtFormat"_test = [] {
+    std::string v;
+    modlog::logfmt_escape(v, "plain");
+    expect(v == std::string{"plain"});
+    v.clear();
+    modlog::logfmt_escape(v, "say \"hi\"\n a=b");
+    expect(v == std::string{"\"say \\\"hi\\\"\\n a=b\""});
+    v.clear();
+    modlog::logfmt_escape(v, "");
+    expect(v == std::string{"\"\""});
+    std::tm tm{};
+    tm.tm_year = 125;
+    tm.tm_mon = 3;
+    tm.tm_mday = 15;
+    std::stringstream ss2;
+    modlog::thread_id_mode = modlog::ThreadIdMode::Name;
+    modlog::set_thread_name("io 3");
+    modlog::logfmt_prefix(ss2, Warning, tm, std::chrono::microseconds{42},
+                          modlog::get_tid(), "a.cpp", 7, false);
+    expect(ss2.str() ==
+           std::string{"level=warn time=2025-04-15T00:00:00.000042 "
+                       "thread=\"io 3\" caller=a.cpp:7 msg="});
+    modlog::thread_id_mode = modlog::ThreadIdMode::Kernel;
+    // as 'os' prefix, message is quoted too
+    std::stringstream out;
+    struct Obj {
+      std::ostream* os;
+      modlog::LogConfig log() {
+        return {.os = os, .fprefixdata{modlog::logfmt_prefix}};
+      }
+    } obj{&out};
+    Log(Info, &obj) << "request done";
+    Log(Info, &obj) << "ok";
+    auto s = out.str();
+    expect(s.find("level=info time=") == 0_u);
+    expect(s.find(" msg=\"request done\"\n") != std::string::npos);
+    expect(s.find(" msg=ok\n") != std::string::npos);
+  };
+
+  "MsgPackFormat"_test = [] {
+    std::stringstream ss2;
+    ss2 << "served" << modlog::kv("status", 200) << modlog::kv("ok", true)
+        << modlog::kv("path", "/a b") << modlog::kv("ratio", 0.5)
+        << modlog::kv("code", "404") << modlog::kv("delta", -3);
+    expect(ss2.str() == std::string{"served status=200 ok=true path=\"/a b\" "
+                                    "ratio=0.5 code=\"404\" delta=-3"});
+    // typed entries come only from kv() on records, in order, and are
+    // removed from "msg"
+    using namespace std::string_literals;
+    std::stringstream out;
+    modlog::OStreamSink sink{out};
+    struct Obj {
+      std::vector<modlog::SinkConfig> sinks;
+      modlog::LogConfig log() { return {.os = nullptr, .sinks = sinks}; }
+    } obj{{{&sink, Info, &modlog::msgpack_format}}};
+    auto ends_with = [](const std::string& s, const std::string& tail) {
+      return s.size() >= tail.size() &&
+             s.compare(s.size() - tail.size(), tail.size(), tail) == 0;
+    };
+    Log(Warning, &obj) << "served" << modlog::kv("status", 200)
+                       << modlog::kv("ok", true) << modlog::kv("path", "/a b")
+                       << modlog::kv("ratio", 0.5) << modlog::kv("code", "404")
+                       << modlog::kv("delta", -3);
+    std::string o = out.str();
+    expect(o[0] == '\x8c' && o.find("\xa5level\xa4warn") == 1_u);
+    expect(ends_with(o, "\xa3msg\xa6served\xa6status\xcc\xc8\xa2ok\xc3"
+                        "\xa4path\xa4/a b\xa5ratio\xcb\x3f\xe0\0\0\0\0\0\0"s
+                        "\xa4" "code\xa3" "404\xa5" "delta\xfd"s));
+    // text that reads as fields is not a field
+    out.str("");
+    Log(Info, &obj) << "retry count=3";
+    o = out.str();
+    expect(o[0] == '\x86' && ends_with(o, "\xa3msg\xadretry count=3"));
+    // nor are kv() with reserved or invalid keys
+    out.str("");
+    Log(Info, &obj) << "x" << modlog::kv("msg", 1) << modlog::kv("a b", 2)
+                    << modlog::kv("", 3);
+    o = out.str();
+    expect(o[0] == '\x86' && ends_with(o, "\xa3msg\xb0x msg=1 a b=2 =3"));
+    // fields may be followed by text; large unsigned values are kept
+    out.str("");
+    Log(Info, &obj) << "took" << modlog::kv("ms", 5) << " total"
+                    << modlog::kv("big", ~std::uint64_t{0});
+    o = out.str();
+    expect(o[0] == '\x88' &&
+           ends_with(o, "\xa3msg\xaatook total\xa2ms\x05\xa3" "big\xcf"
+                        "\xff\xff\xff\xff\xff\xff\xff\xff"));
+    // many fields grow the map
+    out.str("");
+    {
+      auto msg = Log(Info, &obj);
+      for (int k = 0; k < 12; k++)
+        msg << modlog::kv("k" + std::to_string(k), k);
+    }
+    o = out.str();
+    expect(o[0] == '\xde' && o[1] == 0 && o[2] == 18);
+    // records are concatenated maps, with no line breaks (time and tid are
+    // binary, so other bytes may read as one)
+    out.str("");
+    Log(Info, &obj) << "a" << modlog::kv("n", 1);
+    Log(Info, &obj) << "b";
+    o = out.str();
+    expect(o[0] == '\x87');
+    expect(o.find("\xa3msg\xa1" "a\xa1n\x01\x86") != std::string::npos);
+    expect(ends_with(o, "\xa3msg\xa1" "b"));
+    // asynchronous records keep their fields
+    out.str("");
+    modlog::AsyncLogger async;
+    expect(async.start(8));
+    modlog::RecordStream rs;
+    rs << "c" << modlog::kv("n", 2);
+    expect(async.push({Info, "all_ut.cpp", 1, false},
+                      modlog::FuncLogPrefix{modlog::default_prefix_data},
+                      nullptr, obj.sinks, rs.buf, false, Info, &rs.fields));
+    async.flush();
+    async.stop();
+    o = out.str();
+    expect(o[0] == '\x87' && ends_with(o, "\xa3msg\xa1" "c\xa1n\x02"));
+  };
+
+  "StartLogs"_test = [] {
+    namespace fs = std::filesystem;
+    auto dir = fs::temp_directory_path() / "modlog_ut_files";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::stringstream ss2;
+    modlog::modlog_default.os = &ss2;
+    expect(modlog::StartLogs("app_ut", dir.string()));
+    Log(Info) << "to info";
+    Log(modlog::LogLevel::Error) << "to error";
+    modlog::StopLogs();
+    Log(Info) << "after stop";
+    modlog::modlog_default.os = &std::cerr;
+
+    auto read = [&dir](std::string level) {
+      std::ifstream f{dir / ("app_ut." + level)};
+      return std::string{std::istreambuf_iterator<char>{f}, {}};
+    };
+    std::string info = read("INFO");
+    std::string error = read("ERROR");
+    expect(info.rfind("Log file created at: ", 0) == 0);
+    expect(info.find("to info\n") != std::string::npos);
+    expect(info.find("to error\n") != std::string::npos);
+    expect(info.find("after stop") == std::string::npos);
+    expect(error.find("to info") == std::string::npos);
+    expect(error.find("] to error\n") != std::string::npos);
+    expect(ss2.str().find("after stop\n") != std::string::npos);
+    expect(fs::exists(dir / "app_ut.WARNING"));
+    expect(!fs::exists(dir / "app_ut.FATAL"));
+    fs::remove_all(dir);
+  };
+
+  "StartAsync"_test = [] {
+    std::stringstream ss2;
+    modlog::modlog_default.os = &ss2;
+    modlog::thread_id_mode = modlog::ThreadIdMode::Name;
+    expect(modlog::StartAsync(64));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+      threads.emplace_back([t] {
+        modlog::set_thread_name("w" + std::to_string(t));
+        for (int k = 0; k < 1000; k++) Log(Info) << "w" << t << " " << k;
+      });
+    }
+    for (auto& th : threads) th.join();
+    modlog::FlushLogs();
+    modlog::StopAsync();
+    expect(!modlog::async_logger.running());
+    modlog::modlog_default.os = &std::cerr;
+    modlog::thread_id_mode = modlog::ThreadIdMode::Kernel;
+
+    std::istringstream iss{ss2.str()};
+    std::string line;
+    int count = 0;
+    bool intact = true;
+    while (std::getline(iss, line)) {
+      count++;
+      // I20250415 14:28:33.121300 w0 all_ut.cpp:128] w0 17
+      auto pos = line.find("] ");
+      intact = intact && line[0] == 'I' && pos != std::string::npos;
+      if (!intact) break;
+      std::string thread = line.substr(line.find(' ', 10) + 1, 2);
+      intact = line.compare(pos + 2, 2, thread) == 0;
+    }
+    expect(intact);
+    expect(count == 4000_i);
+  };
+
+  "AsyncThreadExit"_test = [] {
+    std::stringstream ss2;
+    modlog::modlog_default.os = &ss2;
+    expect(modlog::StartAsync(16));
+    // short-lived threads: rings are drained and recycled after exit
+    for (int t = 0; t < 20; t++)
+      std::thread{[] {
+        for (int k = 0; k < 10; k++) Log(Info) << "k=" << k;
+      }}.join();
+    modlog::FlushLogs();
+    modlog::StopAsync();
+    modlog::modlog_default.os = &std::cerr;
+    std::string out = ss2.str();
+    expect(std::count(out.begin(), out.end(), '\n') == 200_i);
+  };
+
+  "AsyncOverflow"_test = [] {
+    using modlog::LogLevel::Error;
+    // holds backend on first record, until released
+    struct GateSink : modlog::LogSink {
+      std::atomic<bool> entered{false}, released{false};
+      void write(modlog::LogLevel, std::string_view) override {
+        entered = true;
+        while (!released) std::this_thread::yield();
+      }
+    } gate;
+    std::stringstream ss2;
+    modlog::modlog_default.os = &ss2;
+    modlog::modlog_default.sinks = {{&gate}};
+    auto& async = modlog::async_logger;
+    async.overflow(Info, modlog::Overflow::DropNewest);
+    async.overflow(Error, modlog::Overflow::DropNewest);
+    expect(modlog::StartAsync(4));
+    Log(Info) << "held";
+    while (!gate.entered) std::this_thread::yield();
+    // backend is held on a cell of ring (capacity 4), leaving 3 free
+    for (int k = 0; k < 20; k++) Log(Info) << "info " << k;
+    Log(Error) << "never lost";
+    gate.released = true;
+    modlog::FlushLogs();
+    modlog::StopAsync();
+    async.overflow(Info, modlog::Overflow::Block);
+    async.overflow(Error, modlog::Overflow::Block);
+    modlog::modlog_default.sinks.clear();
+    modlog::modlog_default.os = &std::cerr;
+
+    std::string out = ss2.str();
+    expect(async.dropped() == 17_u);
+    expect(out.find("info 2\n") != std::string::npos);
+    expect(out.find("info 3\n") == std::string::npos);
+    expect(out.find("never lost\n") != std::string::npos);
+    expect(out.find("modlog: 17 records dropped\n") != std::string::npos);
+  };
+
+  "AsyncLoggers"_test = [] {
+    // each logger has its own thread rings
+    std::stringstream s1, s2;
+    modlog::AsyncLogger a, b;
+    expect(a.start(8) && b.start(8));
+    modlog::RecordInfo info{Info, "all_ut.cpp", 1, false};
+    expect(a.push(info, {}, &s1, {}, "to a\n"));
+    a.stop();
+    expect(b.push(info, {}, &s2, {}, "to b\n"));
+    b.flush();
+    b.stop();
+    expect(s1.str() == "to a\n");
+    expect(s2.str() == "to b\n");
+    // records accepted while stop() runs are all written by it
+    std::stringstream s3;
+    modlog::AsyncLogger c;
+    expect(c.start(8));
+    std::atomic<int> accepted{0};
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 4; t++)
+      producers.emplace_back([&] {
+        while (c.push(info, {}, &s3, {}, "x")) accepted++;
+      });
+    while (accepted < 1000) std::this_thread::yield();
+    c.stop();
+    for (auto& p : producers) p.join();
+    expect(s3.str().size() == static_cast<std::size_t>(accepted.load()));
+  };
+
+  "MultiSink"_test = [] {
+    static int prefix_calls = 0;
+    modlog::PrefixFn counting = [](std::ostream& os, modlog::LogLevel,
+                                   std::tm, std::chrono::microseconds,
+                                   std::uintptr_t, std::string_view, int,
+                                   bool) -> std::ostream& {
+      prefix_calls++;
+      return os << "P ";
+    };
+    modlog::LogFormat fmt{counting};
+    std::stringstream console, all, warn, json;
+    modlog::OStreamSink all_sink{all}, warn_sink{warn}, json_sink{json};
+    struct Obj {
+      std::ostream* os;
+      modlog::PrefixFn prefix;
+      std::vector<modlog::SinkConfig> sinks;
+      modlog::LogConfig log() {
+        return {.os = os, .fprefixdata{prefix}, .sinks = sinks};
+      }
+    } obj{&console, counting,
+          {{&all_sink, modlog::LogLevel::Debug, &fmt},
+           {&warn_sink, Warning, &fmt},
+           {&json_sink, Info, &modlog::json_format}}};
+
+    Log(Info, &obj) << "say \"hi\"";
+    Log(Warning, &obj) << "careful" << std::endl;
+    // os and two text sinks share one rendering per record
+    expect(prefix_calls == 2_i);
+    expect(console.str() == "P say \"hi\"\nP careful\n");
+    expect(all.str() == console.str());
+    expect(warn.str() == "P careful\n");
+    std::string j = json.str();
+    expect(j.find("\"msg\":\"say \\\"hi\\\"\"}\n") != std::string::npos);
+    expect(j.find("\"msg\":\"careful\"}\n") != std::string::npos);
+  };
+
+  "ObjectConfigRef"_test = [] {
+    // a config returned by reference is used in place: a sink added while
+    // a message is open still gets its record
+    std::stringstream first, second;
+    modlog::OStreamSink first_sink{first}, second_sink{second};
+    struct Obj {
+      modlog::LogConfig cfg;
+      modlog::LogConfig& log() { return cfg; }
+    } obj;
+    obj.cfg.os = nullptr;
+    obj.cfg.prefix = false;  // (records as written)
+    obj.cfg.sinks.push_back({&first_sink, Info});
+    Log(Info, &obj) << "one\n";
+    // (a message is not kept as a stream, it is written at its end)
+    static_assert(!std::is_convertible_v<modlog::LogMessage, std::ostream&>);
+    {
+      auto msg = Log(Info, &obj);
+      msg << "two\n";
+      obj.cfg.sinks.push_back({&second_sink, Info});
+    }
+    Log(modlog::LogLevel::Debug, &obj) << "hidden";
+    expect(first.str() == "one\ntwo\n");
+    expect(second.str() == "two\n");
+  };
+
+  "InterleaveFree"_test = [] {
+    namespace fs = std::filesystem;
+    auto path = (fs::temp_directory_path() / "modlog_interleave_ut.log");
+    fs::remove(path);
+    // two descriptors appending to the same file (as two processes would)
+    modlog::FdSink a, b;
+    expect(a.open(path.string()) && b.open(path.string()));
+    std::string piped;
+    std::vector<modlog::SinkConfig> sinks{{&a}, {&b}};
+#ifndef _WIN32
+    int p[2];
+    expect(::pipe(p) == 0_i);
+    modlog::FdSink pipe_sink{p[1]};
+    sinks.push_back({&pipe_sink});
+    std::thread reader{[&piped, fd = p[0]] {
+      char buf[4096];
+      for (ssize_t n; (n = ::read(fd, buf, sizeof(buf))) > 0;)
+        piped.append(buf, static_cast<std::size_t>(n));
+    }};
+#endif
+    struct Obj {
+      std::vector<modlog::SinkConfig>* sinks;
+      modlog::LogConfig log() { return {.os = nullptr, .sinks = *sinks}; }
+    } obj{&sinks};
+    constexpr int threads = 8, records = 1000;
+    std::vector<std::thread> ts;
+    for (int t = 0; t < threads; t++) {
+      ts.emplace_back([t, &obj] {
+        for (int k = 0; k < records; k++)
+          Log(Info, &obj) << "t=" << t << " k=" << k << " "
+                          << std::string(k * 37 % 2000 + 1, 'a' + t);
+      });
+    }
+    for (auto& th : ts) th.join();
+    a.close();
+    b.close();
+    // every line: prefix, "t=<t> k=<k> " and its own payload, intact
+    auto check = [](const std::string& text, int expected) {
+      std::istringstream iss{text};
+      std::string line;
+      int count = 0;
+      bool intact = true;
+      while (std::getline(iss, line)) {
+        count++;
+        int t = -1, k = -1;
+        auto pos = line.find("] t=");
+        if (pos == std::string::npos ||
+            std::sscanf(line.c_str() + pos, "] t=%d k=%d", &t, &k) != 2 ||
+            t < 0 || t >= threads) {
+          intact = false;
+          break;
+        }
+        std::string payload(k * 37 % 2000 + 1, 'a' + t);
+        intact = line.size() >= payload.size() &&
+                 line.compare(line.size() - payload.size(), payload.size(),
+                              payload) == 0 &&
+                 line[line.size() - payload.size() - 1] == ' ';
+        if (!intact) break;
+      }
+      return intact && count == expected;
+    };
+    std::ifstream f{path};
+    expect(check(std::string{std::istreambuf_iterator<char>{f}, {}},
+                 2 * threads * records));
+#ifndef _WIN32
+    ::close(p[1]);
+    reader.join();
+    ::close(p[0]);
+    // pipe got each record once (writes up to PIPE_BUF are atomic)
+    expect(check(piped, threads * records));
+#endif
+    fs::remove(path);
+  };
+
+  "FlushPolicy"_test = [] {
+    using modlog::LogLevel::Error;
+    struct CountingSink : modlog::LogSink {
+      std::atomic<int> flushes{0};
+      void write(modlog::LogLevel, std::string_view) override {}
+      void flush() override { flushes++; }
+    } sink;
+    // a stream that counts its flushes
+    struct CountingBuf : std::stringbuf {
+      std::atomic<int> syncs{0};
+      int sync() override {
+        syncs++;
+        return 0;
+      }
+    } buf;
+    std::ostream os{&buf};
+    sink.flush_policy.level = Error;
+    sink.flush_policy.bytes = 2000;
+    struct Obj {
+      std::ostream* os;
+      modlog::SinkConfig sink;
+      modlog::LogConfig log() {
+        return {.os = os, .sinks = {sink}, .flush_level = Error};
+      }
+    } obj{&os, {&sink}};
+    for (int k = 0; k < 10; k++) Log(Info, &obj) << std::string(90, 'x');
+    expect(sink.flushes.load() == 0_i);  // under 2000 bytes
+    Log(Info, &obj) << std::string(800, 'x');
+    expect(sink.flushes.load() == 1_i);  // size threshold
+    Log(Error, &obj) << "now";
+    expect(sink.flushes.load() == 2_i);  // level
+    expect(buf.syncs.load() == 1_i);     // 'os' only flushed at Error
+    // periodic flushes from background timer
+    sink.flush_policy.interval = std::chrono::milliseconds{5};
+    modlog::flush_timer.add(&sink);
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    modlog::flush_timer.remove(&sink);
+    int flushes = sink.flushes;
+    expect(flushes > 4_i);
+    std::this_thread::sleep_for(std::chrono::milliseconds{20});
+    expect(sink.flushes.load() == flushes);
+    // an idle FileSink is flushed by flush_timer (added on open)
+    auto path = std::filesystem::temp_directory_path() / "modlog_flush_ut.log";
+    std::filesystem::remove(path);
+    modlog::FileSink file;
+    file.flush_policy.interval = std::chrono::milliseconds{5};
+    expect(file.open(path.string()));
+    file.write(Info, "buffered\n");
+    for (int k = 0; k < 1000 && std::filesystem::file_size(path) == 0; k++)
+      std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    expect(std::filesystem::file_size(path) == 9_u);
+    file.close();
+    std::filesystem::remove(path);
+    // asynchronous: 'os' is flushed after a batch only if it had an Error
+    struct MarkSink : modlog::LogSink {
+      std::atomic<int> seen{0};
+      void write(modlog::LogLevel, std::string_view) override { seen++; }
+    } mark;
+    modlog::AsyncLogger async;
+    expect(async.start(64));
+    modlog::RecordInfo info{Info, "all_ut.cpp", 1, false};
+    // (a batch is written and flushed before the second mark is written)
+    auto next_batch = [&, n = 0]() mutable {
+      for (int k = 0; k < 2; k++) {
+        async.push(info, {}, nullptr, {{&mark}}, "mark\n");
+        ++n;
+        while (mark.seen < n) std::this_thread::yield();
+      }
+    };
+    buf.syncs = 0;
+    for (int k = 0; k < 10; k++)
+      async.push(info, {}, &os, {}, "info\n", false, Error);
+    next_batch();
+    expect(buf.syncs.load() == 0_i);
+    info.level = Error;
+    async.push(info, {}, &os, {}, "error\n", false, Error);
+    info.level = Info;
+    next_batch();
+    expect(buf.syncs.load() == 1_i);
+    async.stop();
+  };
+
+  "FileRotation"_test = [] {
+    namespace fs = std::filesystem;
+    auto dir = fs::temp_directory_path() / "modlog_rotation_ut";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::string path = (dir / "app.log").string();
+    modlog::FileSink file;
+    file.max_size = 100;
+    file.max_files = 3;
+    expect(file.open(path));
+    for (int k = 1; k <= 10; k++) {
+      // 30 bytes each, so each file keeps 3 records
+      std::string rec = "record " + std::to_string(k % 10) +
+                        std::string(21, '.') + "\n";
+      file.write(Info, rec);
+      modlog::file_tasks.wait();  // next file is ready before each write
+    }
+    file.close();
+    auto read = [](const fs::path& p) {
+      std::ifstream f{p};
+      return std::string{std::istreambuf_iterator<char>{f}, {}};
+    };
+    expect(read(dir / "app.log").rfind("record 0", 0) == 0);
+    expect(read(dir / "app.log.1").rfind("record 7", 0) == 0);
+    expect(read(dir / "app.log.2").rfind("record 4", 0) == 0);
+    expect(fs::file_size(dir / "app.log.2") == 90_u);
+    expect(!fs::exists(dir / "app.log.3"));
+    expect(!fs::exists(dir / "app.log.next"));
+    // writes racing with close() leave no task or file ahead behind
+    {
+      modlog::FileSink late;
+      late.max_size = 100;
+      expect(late.open(path));
+      std::thread writer{[&late] {
+        for (int k = 0; k < 50; k++) late.write(Info, std::string(39, 'x'));
+      }};
+      late.close();
+      writer.join();
+      late.write(Info, "after close\n");
+    }
+    modlog::file_tasks.wait();
+    expect(!fs::exists(dir / "app.log.next"));
+    expect(read(dir / "app.log").find("after close") == std::string::npos);
+    fs::remove_all(dir);
+  };
+
+  "TimeRotation"_test = [] {
+    namespace fs = std::filesystem;
+    auto dir = fs::temp_directory_path() / "modlog_time_ut";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::string base = (dir / "app.log").string();
+    // expired file of an old period
+    std::string old = base + ".20000101-000000.7";
+    std::ofstream{old} << "old\n";
+    fs::last_write_time(old, fs::file_time_type::clock::now() -
+                                 std::chrono::hours{48});
+    auto now = std::time(nullptr);
+    auto start = modlog::period_start(now, modlog::Rotation::Hourly);
+    auto next = modlog::period_end(now, modlog::Rotation::Hourly);
+    expect(next - start == 3600_l);
+    expect(modlog::file_stamp(start).substr(11) == "0000");
+
+    modlog::FileSink file;
+    file.rotation = modlog::Rotation::Hourly;
+    file.max_age = std::chrono::hours{24};
+    expect(file.open(base, ".7"));
+    file.write(Info, "in this hour\n");
+    modlog::file_tasks.wait();
+    expect(file.path() == base + "." + modlog::file_stamp(start) + ".7");
+    // next period is opened ahead, expired files are removed
+    expect(fs::exists(base + "." + modlog::file_stamp(next) + ".7"));
+    expect(!fs::exists(old));
+    // after an idle period, a record goes to the file of its own period
+    auto later = std::chrono::system_clock::now() + std::chrono::hours{3};
+    file.write_at(Info, "three hours later\n", later);
+    modlog::file_tasks.wait();
+    auto later_start = modlog::period_start(
+        std::chrono::system_clock::to_time_t(later), modlog::Rotation::Hourly);
+    expect(file.path() == base + "." + modlog::file_stamp(later_start) + ".7");
+    file.close();
+    expect(!fs::exists(base + "." + modlog::file_stamp(next) + ".7"));
+    expect(fs::file_size(base + "." + modlog::file_stamp(start) + ".7") ==
+           13_u);
+    expect(fs::file_size(base + "." + modlog::file_stamp(later_start) +
+                         ".7") == 18_u);
+    fs::remove_all(dir);
+  };
+
+  "Lz4FileSink"_test = [] {
+    namespace fs = std::filesystem;
+    auto path = (fs::temp_directory_path() / "modlog_lz4_ut.log.lz4").string();
+    fs::remove(path);
+    std::string expected;
+    for (int round = 0; round < 2; round++) {
+      // reopening appends another frame
+      modlog::FileSink file;
+      file.compress = true;
+      file.buffer_size = 4096;
+      expect(file.open(path));
+      for (int k = 0; k < 1000; k++) {
+        std::string rec = "I 20260101 12:00:00.000000 all_ut.cpp:1] record " +
+                          std::to_string(k) + "\n";
+        file.write(Info, rec);
+        expected += rec;
+      }
+      std::string big(10000, 'x');  // larger than buffer
+      big += "\n";
+      file.write(Info, big);
+      expected += big;
+      file.close();
+    }
+    expect(modlog::read_log_file(path) == expected);
+    expect(fs::file_size(path) < expected.size() / 4);
+    std::string out;
+    expect(!modlog::lz4_decompress("not lz4", out));
+    fs::remove(path);
+  };
+
+  "BinaryFileSink"_test = [] {
+    namespace fs = std::filesystem;
+    auto path = (fs::temp_directory_path() / "modlog_binary_ut.mlb").string();
+    fs::remove(path);
+    fs::remove(path + ".idx");
+    modlog::BinaryFileSink sink;
+    sink.segment_bytes = 4096;
+    expect(sink.open(path));
+    // one record per second, from 10:00 to 12:00, on two callsites
+    std::tm tm{};
+    tm.tm_year = 125;
+    tm.tm_mon = 3;
+    tm.tm_mday = 15;
+    for (int k = 0; k < 7200; k++) {
+      tm.tm_hour = 10 + k / 3600;
+      tm.tm_min = k / 60 % 60;
+      tm.tm_sec = k % 60;
+      std::stringstream prefix;
+      modlog::binary_prefix(prefix, Info, tm, std::chrono::microseconds{k}, 7,
+                            k % 2 ? "a.cpp" : "b.cpp", 10 + k % 2, false);
+      std::string r = prefix.str();
+      modlog::binary_escape(r, "record " + std::to_string(k));
+      sink.write(Info, r + "\n");
+    }
+    sink.close();
+    expect(fs::file_size(path) < 7200 * 20);
+    modlog::BinaryLogReader reader;
+    expect(reader.open(path));
+    expect(reader.index().size() > 20_u);
+    tm.tm_hour = 10;
+    tm.tm_min = 42;
+    tm.tm_sec = 0;
+    auto from = modlog::wall_time_us(tm);
+    tm.tm_min = 43;
+    std::vector<std::string> got;
+    bool ok = true;
+    reader.for_range(from, modlog::wall_time_us(tm),
+                     [&](const modlog::BinaryRecord& r) {
+                       got.emplace_back(r.msg);
+                       ok = ok && r.tid == 7 && r.level == Info &&
+                            r.line == (r.file == "a.cpp" ? 11 : 10);
+                     });
+    expect(ok);
+    expect(got.size() == 60_u);
+    expect(got.front() == std::string{"record 2520"});
+    expect(got.back() == std::string{"record 2579"});
+    expect(reader.decoded <= 2_u);
+    // through a LogConfig sink; unindexed segments are read too
+    std::stringstream ss2;
+    struct Obj {
+      std::ostream* os;
+      std::vector<modlog::SinkConfig> sinks;
+      modlog::LogConfig log() { return {.os = os, .sinks = sinks}; }
+    } obj{&ss2, {{&sink, Info, &modlog::binary_format}}};
+    expect(sink.open(path));
+    Log(Warning, &obj) << "hello " << 42;
+    sink.flush();
+    expect(reader.open(path));
+    got.clear();
+    reader.for_each([&](const modlog::BinaryRecord& r) {
+      if (r.level == Warning && r.file == "all_ut.cpp") got.emplace_back(r.msg);
+    });
+    expect(got.size() == 1_u && got[0] == std::string{"hello 42"});
+    sink.close();
+    fs::remove(path);
+    fs::remove(path + ".idx");
+  };
+
+  "LogFileView"_test = [] {
+    namespace fs = std::filesystem;
+    auto dir = fs::temp_directory_path() / "modlog_view_ut";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::int64_t t0 = 0;
+    expect(modlog::parse_wall_time("2025-04-15T10:42", t0));
+    std::tm tm{};
+    tm.tm_year = 125;
+    tm.tm_mon = 3;
+    tm.tm_mday = 15;
+    tm.tm_hour = 10;
+    tm.tm_min = 42;
+    expect(t0 == modlog::wall_time_us(tm));
+    // same records, in each format
+    struct Out {
+      const modlog::LogFormat* format;
+      std::string name;
+    };
+    std::vector<Out> outs{{&modlog::text_format, "a.log"},
+                          {&modlog::json_format, "a.json"},
+                          {&modlog::logfmt_format, "a.logfmt"},
+                          {&modlog::binary_format, "a.mlb"}};
+    std::vector<std::unique_ptr<modlog::LogSink>> sinks;
+    std::stringstream ss2;
+    struct Obj {
+      std::ostream* os;
+      std::vector<modlog::SinkConfig> sinks;
+      modlog::LogConfig log() { return {.os = os, .sinks = sinks}; }
+    } obj{&ss2, {}};
+    for (auto& o : outs) {
+      auto path = (dir / o.name).string();
+      if (o.format == &modlog::binary_format) {
+        auto s = std::make_unique<modlog::BinaryFileSink>();
+        s->open(path);
+        sinks.push_back(std::move(s));
+      } else {
+        auto s = std::make_unique<modlog::FdSink>();
+        s->open(path);
+        sinks.push_back(std::move(s));
+      }
+      obj.sinks.push_back({sinks.back().get(), Info, o.format});
+    }
+    Log(Info, &obj) << "first";
+    Log(Warning, &obj) << "second\nwith two lines";
+    Log(modlog::LogLevel::Error, &obj) << "third";
+    for (auto& s : sinks) s->close();
+    for (auto& o : outs) {
+      modlog::LogFileView view;
+      expect(view.open((dir / o.name).string()));
+      std::vector<modlog::LogRecordView> rs;
+      view.for_each([&](const modlog::LogRecordView& r) { rs.push_back(r); });
+      expect(rs.size() == 3_u) << o.name;
+      if (rs.size() != 3) continue;
+      expect(rs[0].msg == "first") << o.name;
+      expect(rs[1].level == Warning && rs[2].level == modlog::LogLevel::Error);
+      expect(rs[2].file == "all_ut.cpp" && rs[2].line > rs[1].line);
+      expect(rs[0].time <= rs[2].time && rs[0].time > t0);
+      if (view.format() != modlog::LogFileFormat::Text) continue;
+      // records are views of the file: a search finds its record
+      auto d = view.data();
+      auto r = view.record_at(d.find("two lines"));
+      expect(r.text.data() == rs[1].text.data());
+      expect(r.msg == "second\nwith two lines");
+    }
+    fs::remove_all(dir);
+  };
+
+  "SemStream"_test = [] {
+    modlog::SemStream sem;
+    sem << "{\"n\":" << 1 << "}\n";
+    expect(sem.dump() == std::string{"{\"n\":1}\n"});
+    // (capturing, 'os' is the stream itself)
+    *sem.os << "via os";
+    sem.os->flush();
+    expect(sem.capturing() && sem.dump() == std::string{"via os"});
+    expect(sem.dump().empty());
+    // concurrent appends (growing buffers) while dumping
+    std::atomic<bool> done{false};
+    std::string all;
+    std::thread dumper{[&] {
+      while (!done) all += sem.dump();
+    }};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+      threads.emplace_back([t, &sem] {
+        for (int k = 0; k < 20000; k++) {
+          std::string rec = std::to_string(t) + " " + std::to_string(k) + "\n";
+          if (k % 2)
+            sem.append(rec);
+          else
+            sem.write(rec.data(), static_cast<std::streamsize>(rec.size()));
+        }
+      });
+    }
+    for (auto& th : threads) th.join();
+    done = true;
+    dumper.join();
+    all += sem.dump();
+    std::istringstream iss{all};
+    int next[4] = {0, 0, 0, 0};
+    bool ordered = true;
+    for (int t, k; iss >> t >> k;) ordered = ordered && next[t]++ == k;
+    expect(ordered);
+    expect(next[0] == 20000_i && next[3] == 20000_i);
+    // forwarding to another stream
+    std::stringstream out;
+    modlog::SemStream fwd{out};
+    fwd << "x=" << 2;
+    expect(out.str() == std::string{"x=2"});
+    expect(!fwd.capturing() && fwd.dump().empty());
+  };
+
+  "SemChannels"_test = [] {
+    modlog::SemChannels channels;
+    auto& trace = channels.channel("trace");
+    expect(&channels.channel("trace") == &trace);
+    expect(channels.find("metrics") == nullptr);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+      threads.emplace_back([t, &channels] {
+        auto& ch = channels.channel(t % 2 ? "trace" : "metrics");
+        for (int k = 0; k < 20000; k++)
+          ch.append(k % 100 ? Info : Warning,
+                    std::to_string(t) + " " + std::to_string(k));
+      });
+    }
+    for (auto& th : threads) th.join();
+    expect(trace.size() == 40000_u);
+    int next[4] = {0, 0, 0, 0};
+    bool ordered = true;
+    trace.for_each([&](modlog::LogLevel, std::string_view r) {
+      int t = r[0] - '0';
+      ordered = ordered && std::to_string(next[t]++) == r.substr(2);
+    });
+    expect(ordered);
+    auto* metrics = channels.find("metrics");
+    expect(metrics != nullptr);
+    auto warns = metrics->select(
+        [](modlog::LogLevel l, std::string_view) { return l >= Warning; });
+    expect(warns.size() == 400_u);
+    // as a sink of records, exported to another sink
+    auto& json = channels.channel("json");
+    struct Obj {
+      modlog::SinkConfig sink;
+      modlog::LogConfig log() {
+        return {.os = nullptr, .prefix = true, .sinks = {sink}};
+      }
+    } obj{{&json, Info, &modlog::json_format}};
+    Log(Info, &obj) << "solver step";
+    std::stringstream out;
+    modlog::OStreamSink out_sink{out};
+    expect(json.export_to(out_sink) == 1_u);
+    expect(out.str().find("\"msg\":\"solver step\"}\n") != std::string::npos);
+  };
+
+#ifndef _WIN32
+  "MmapFileSink"_test = [] {
+    namespace fs = std::filesystem;
+    auto path = fs::temp_directory_path() / "modlog_mmap_ut.log";
+    fs::remove(path);
+    modlog::MmapFileSink file;
+    file.chunk = 4096;  // remapped a few times
+    expect(file.open(path.string()));
+    std::string expected;
+    for (int k = 0; k < 1000; k++) {
+      std::string rec = "mmap record " + std::to_string(k) + "\n";
+      file.write(Info, rec);
+      expected += rec;
+    }
+    // mapping is larger than records, until closed on StopLogs()
+    expect(fs::file_size(path) > expected.size());
+    modlog::modlog_default.sinks.push_back({&file});
+    modlog::StopLogs();
+    modlog::modlog_default.sinks.clear();
+    std::ifstream f{path};
+    std::string got{std::istreambuf_iterator<char>{f}, {}};
+    expect(got == expected);
+    // zeros left by a crash are trimmed on open
+    fs::resize_file(path, expected.size() + 10000);
+    expect(file.open(path.string()));
+    expect(file.size() == expected.size());
+    file.write(Info, "after crash\n");
+    file.close();
+    expect(fs::file_size(path) == expected.size() + 12);
+    fs::remove(path);
+  };
+
+  "FlightRecorder"_test = [] {
+    namespace fs = std::filesystem;
+    auto path = (fs::temp_directory_path() / "modlog_flight_ut.ring").string();
+    std::stringstream ss2;
+    modlog::modlog_default.os = &ss2;
+    expect(modlog::StartFlightRecorder(path, 4096));
+    Log(modlog::LogLevel::Debug) << "debug context";
+    modlog::VLog(3) << "verbose context";
+    Log(Info) << "visible";
+    expect(ss2.str().find("context") == std::string::npos);
+    std::string kept = modlog::FlightRecorder::recover(path);
+    expect(kept.rfind("D", 0) == 0);
+    expect(kept.find("debug context\n") != std::string::npos);
+    expect(kept.find("verbose context\n") != std::string::npos);
+    expect(kept.find("visible\n") != std::string::npos);
+    // ring keeps only last records, from a record boundary
+    for (int k = 0; k < 500; k++) Log(modlog::LogLevel::Debug) << "rec " << k;
+    kept = modlog::FlightRecorder::recover(path);
+    expect(kept.size() <= 4096_u);
+    expect(kept.find("debug context") == std::string::npos);
+    expect(kept.find("] rec 499\n") != std::string::npos);
+    expect(kept.rfind("D", 0) == 0);
+    modlog::StopFlightRecorder();
+    Log(modlog::LogLevel::Debug) << "not kept";
+    expect(modlog::FlightRecorder::recover(path).find("not kept") ==
+           std::string::npos);
+    // a restart keeps the previous ring on <path>.prev
+    expect(modlog::StartFlightRecorder(path, 4096));
+    expect(modlog::FlightRecorder::recover(path).empty());
+    kept = modlog::FlightRecorder::recover(path + ".prev");
+    expect(kept.find("] rec 499\n") != std::string::npos);
+    modlog::StopFlightRecorder();
+    // (an empty ring does not replace it)
+    expect(modlog::StartFlightRecorder(path, 4096));
+    modlog::StopFlightRecorder();
+    kept = modlog::FlightRecorder::recover(path + ".prev");
+    expect(kept.find("] rec 499\n") != std::string::npos);
+    modlog::modlog_default.os = &std::cerr;
+    fs::remove(path);
+    fs::remove(path + ".prev");
+  };
+
+  "SyslogSink"_test = [] {
+    namespace fs = std::filesystem;
+    std::string path =
+        (fs::temp_directory_path() / "modlog_syslog_ut.sock").string();
+    ::unlink(path.c_str());
+    // stands in for the daemon
+    int daemon = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    expect(::bind(daemon, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) ==
+           0_i);
+    auto receive = [daemon]() {
+      std::vector<std::string> v;
+      char buf[4096];
+      for (ssize_t n;
+           (n = ::recv(daemon, buf, sizeof(buf), MSG_DONTWAIT)) >= 0;)
+        v.emplace_back(buf, static_cast<std::size_t>(n));
+      return v;
+    };
+    std::string pid = std::to_string(::getpid());
+    modlog::SyslogSink sink;
+    sink.ident = "ut";
+    sink.batch_size = 4;
+    sink.flush_policy.interval = std::chrono::hours{1};
+    expect(sink.open(path));
+    // (as records written by Log(), with flush policy)
+    auto put = [&sink](modlog::LogLevel l, const std::string& r) {
+      sink.write(l, r);
+      sink.written(l, r.size());
+    };
+    for (int k = 0; k < 3; k++) put(Info, "info " + std::to_string(k) + "\n");
+    expect(receive().empty());  // batched
+    put(Warning, "warn\n");
+    auto got = receive();
+    expect(got.size() == 4_u);
+    expect(got[0] == "<14>ut[" + pid + "]: info 0");
+    expect(got[3] == "<12>ut[" + pid + "]: warn");
+    // a batch is sent before it would outgrow its buffer (4 * 256 bytes)
+    put(Info, std::string(700, 'a') + "\n");
+    expect(receive().empty());
+    put(Info, std::string(700, 'b') + "\n");
+    expect(receive().size() == 1_u);
+    sink.flush();
+    expect(receive().size() == 1_u);
+    // journald: multi-line message as a binary field
+    expect(sink.open_journald(path));
+    put(modlog::LogLevel::Error, "two\nlines\n");
+    got = receive();
+    expect(got.size() == 1_u);
+    expect(got[0].rfind("PRIORITY=3\nSYSLOG_FACILITY=1\nSYSLOG_IDENTIFIER=ut\n",
+                        0) == 0);
+    std::string field{"MESSAGE\n\x09\0\0\0\0\0\0\0two\nlines\n", 26};
+    expect(got[0].find(field) != std::string::npos);
+    // full socket: records are dropped instead of blocking
+    expect(sink.open(path));
+    sink.when_full = modlog::SocketFull::Drop;
+    for (int k = 0; k < 100000 && sink.dropped() == 0; k++)
+      sink.write(Info, std::string(1000, 'x'));
+    sink.flush();
+    expect(sink.dropped() > 0_u);
+    sink.close();
+    ::close(daemon);
+    ::unlink(path.c_str());
+  };
+
+  "NetworkSink"_test = [] {
+    // loopback collector on a free port
+    auto listen_on = [](int type, int port) {
+      int s = ::socket(AF_INET, type, 0);
+      int one = 1;
+      ::setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      sockaddr_in a{};
+      a.sin_family = AF_INET;
+      a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      a.sin_port = htons(static_cast<std::uint16_t>(port));
+      ::bind(s, reinterpret_cast<sockaddr*>(&a), sizeof(a));
+      if (type == SOCK_STREAM) ::listen(s, 4);
+      return s;
+    };
+    auto port_of = [](int s) {
+      sockaddr_in a{};
+      socklen_t len = sizeof(a);
+      ::getsockname(s, reinterpret_cast<sockaddr*>(&a), &len);
+      return static_cast<int>(ntohs(a.sin_port));
+    };
+    // reads length-framed records until 'n' arrive (or timeout)
+    auto read_frames = [](int conn, std::size_t n) {
+      std::vector<std::string> v;
+      std::string data;
+      char buf[4096];
+      while (v.size() < n) {
+        pollfd p{conn, POLLIN, 0};
+        if (::poll(&p, 1, 2000) <= 0) break;
+        auto r = ::recv(conn, buf, sizeof(buf), 0);
+        if (r <= 0) break;
+        data.append(buf, static_cast<std::size_t>(r));
+        while (data.size() >= 4) {
+          std::size_t len = 0;
+          for (int i = 0; i < 4; i++)
+            len = len << 8 | static_cast<unsigned char>(data[i]);
+          if (data.size() < 4 + len) break;
+          v.push_back(data.substr(4, len));
+          data.erase(0, 4 + len);
+        }
+      }
+      return v;
+    };
+    int server = listen_on(SOCK_STREAM, 0);
+    int port = port_of(server);
+    modlog::NetworkSink sink;
+    sink.framing = modlog::Framing::Length;
+    sink.backoff_min = std::chrono::milliseconds{10};
+    expect(sink.open("127.0.0.1", port));
+    for (int k = 0; k < 100; k++)
+      sink.write(Info, "record " + std::to_string(k) + "\n");
+    sink.flush();
+    expect(sink.connected());
+    int conn = ::accept(server, nullptr, nullptr);
+    auto got = read_frames(conn, 100);
+    expect(got.size() == 100_u);
+    expect(got.front() == "record 0" && got.back() == "record 99");
+    // collector goes down: records are kept, and sent after reconnecting
+    ::close(conn);
+    ::close(server);
+    for (int k = 0; k < 10; k++) {
+      sink.write(Info, "spilled " + std::to_string(k) + "\n");
+      sink.flush();
+    }
+    expect(!sink.connected());
+    server = listen_on(SOCK_STREAM, port);
+    for (int i = 0; i < 200 && !sink.connected(); i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds{5});
+      sink.flush();
+    }
+    conn = ::accept(server, nullptr, nullptr);
+    got = read_frames(conn, 10);
+    expect(got.size() == 10_u);
+    expect(got.front() == "spilled 0" && got.back() == "spilled 9");
+    expect(sink.dropped() == 0_u);
+    sink.close();
+    ::close(conn);
+    ::close(server);
+    // udp: datagrams with whole NDJSON lines
+    int udp = listen_on(SOCK_DGRAM, 0);
+    modlog::NetworkSink usink;
+    usink.transport = modlog::Transport::Udp;
+    expect(usink.open("127.0.0.1", port_of(udp)));
+    for (int k = 0; k < 3; k++)
+      usink.write(Info, "{\"k\":" + std::to_string(k) + "}\n");
+    usink.flush();
+    char buf[2048];
+    auto datagram = [&]() {
+      auto n = ::recv(udp, buf, sizeof(buf), MSG_DONTWAIT);
+      return std::string(buf,
+                         static_cast<std::size_t>(std::max<ssize_t>(n, 0)));
+    };
+    expect(datagram() == "{\"k\":0}\n{\"k\":1}\n{\"k\":2}\n");
+    // a record too large for any datagram is dropped, not retried forever
+    usink.write(Info, std::string(70000, 'x') + "\n");
+    usink.write(Info, "{\"k\":3}\n");
+    usink.flush();
+    expect(usink.dropped() == 1_u);
+    expect(datagram() == "{\"k\":3}\n");
+    usink.close();
+    ::close(udp);
+  };
+
+  "SharedFileSink"_test = [] {
+    namespace fs = std::filesystem;
+    auto path = fs::temp_directory_path() / "modlog_shared_ut.log";
+    fs::remove(path);
+    auto record = [](int k) {
+      std::string r = "record " + std::to_string(k);
+      if (k % 7 == 0) r += "\n  second line";
+      if (k % 50 == 0) r += std::string(10000, static_cast<char>('a' + k % 26));
+      return r + "\n";
+    };
+    modlog::SharedFileSink sink;
+    sink.process_header = true;
+    expect(sink.open(path.string()));
+    sink.write(Info, "parent\n");
+    std::vector<pid_t> pids;
+    for (int c = 0; c < 3; c++) {
+      pid_t pid = ::fork();
+      if (pid == 0) {
+        std::thread t{[&]() {
+          for (int k = 0; k < 200; k += 2) sink.write(Info, record(k));
+        }};
+        for (int k = 1; k < 200; k += 2) sink.write(Info, record(k));
+        t.join();
+        ::_exit(0);
+      }
+      pids.push_back(pid);
+    }
+    for (auto pid : pids) ::waitpid(pid, nullptr, 0);
+    sink.close();
+    std::ifstream in{path, std::ios::binary};
+    std::string text{std::istreambuf_iterator<char>{in}, {}};
+    auto procs = modlog::SharedFileSink::demux(text);
+    expect(procs.size() == 4_u);
+    expect(procs[0].first == ::getpid() && procs[0].second == "parent\n");
+    for (auto& [pid, out] : procs) {
+      if (pid == ::getpid()) continue;
+      expect(std::find(pids.begin(), pids.end(), pid) != pids.end());
+      // each record whole, in order per thread
+      std::size_t even = 0, odd = 0;
+      bool ok = true;
+      for (int k = 0; k < 200; k++) {
+        auto r = record(k);
+        auto& from = k % 2 ? odd : even;
+        auto p = out.find(r, from);
+        ok = ok && p != std::string::npos;
+        if (ok) from = p + r.size();
+      }
+      expect(ok);
+    }
+    // without header, long records are still joined
+    modlog::SharedFileSink plain;
+    expect(plain.open(path.string() + ".plain"));
+    plain.write(Info, record(0));
+    plain.write(Info, "short\n");
+    plain.close();
+    std::ifstream in2{path.string() + ".plain", std::ios::binary};
+    text.assign(std::istreambuf_iterator<char>{in2}, {});
+    expect(text.size() > record(0).size());
+    expect(modlog::SharedFileSink::reassemble(text) == record(0) + "short\n");
+    fs::remove(path);
+    fs::remove(path.string() + ".plain");
+  };
+
+  "CrashHandler"_test = [] {
+    namespace fs = std::filesystem;
+    auto path = fs::temp_directory_path() / "modlog_crash_ut.log";
+    fs::remove(path);
+    pid_t pid = ::fork();
+    if (pid == 0) {
+      ::dup2(::open("/dev/null", O_WRONLY), 2);
+      modlog::FileSink file;  // records stay on its buffer
+      file.open(path.string());
+      modlog::modlog_default.sinks = {{&file}};
+      modlog::modlog_default.os = &modlog::modlog_default.no;
+      modlog::InstallCrashHandler();
+      modlog::StartAsync();
+      for (int k = 0; k < 100; k++) Log(Info) << "queued " << k;
+      ::raise(SIGSEGV);
+      ::_exit(0);
+    }
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    expect(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+    std::ifstream f{path};
+    std::string out{std::istreambuf_iterator<char>{f}, {}};
+    expect(out.find("] queued 99\n") != std::string::npos);
+    auto crash = out.find("*** SIGSEGV (@");
+    expect(crash != std::string::npos && crash > out.find("] queued 99\n"));
+    expect(out.find("    @ 0x") != std::string::npos);
+    fs::remove(path);
+  };
+
+  "FatalDrainsSinks"_test = [] {
+    namespace fs = std::filesystem;
+    auto path = fs::temp_directory_path() / "modlog_fatal_ut.log";
+    for (bool stream : {false, true}) {
+      fs::remove(path);
+      pid_t pid = ::fork();
+      if (pid == 0) {
+        ::dup2(::open("/dev/null", O_WRONLY), 2);
+        modlog::FileSink file;
+        file.open(path.string());
+        std::stringstream ss2;
+        modlog::modlog_default.sinks = {{&file}};
+        modlog::modlog_default.os = &ss2;
+        modlog::StartAsync();
+        for (int k = 0; k < 100; k++) Log(Info) << "queued " << k;
+        if (stream) {
+          modlog::fatal << "fatal " << 42 << std::endl;
+        } else {
+          // two threads fail at once: records must not interleave
+          std::thread t{[]() { Log(modlog::LogLevel::Fatal) << "fatal 1"; }};
+          Log(modlog::LogLevel::Fatal) << "fatal 2";
+          t.join();
+        }
+        ::_exit(0);
+      }
+      int status = 0;
+      ::waitpid(pid, &status, 0);
+      expect(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+      std::ifstream f{path};
+      std::string out{std::istreambuf_iterator<char>{f}, {}};
+      auto fatal = out.find("\nF");
+      expect(out.find("] queued 99\n") < fatal);
+      if (stream)
+        expect(out.find("] fatal 42\n") != std::string::npos);
+      else
+        expect(out.find("] fatal 1\n") != std::string::npos ||
+               out.find("] fatal 2\n") != std::string::npos);
+      expect(out.find("*** Check failure stack trace: ***\n    @ 0x") >
+             fatal);
+    }
+    fs::remove(path);
+  };
+#endif
+
+#ifdef MODLOG_HAS_IO_URING
+  "UringFileSink"_test = [] {
+    namespace fs = std::filesystem;
+    auto path = fs::temp_directory_path() / "modlog_uring_ut.log";
+    // io_uring (if available on this kernel) and pwritev fallback
+    for (bool uring : {true, false}) {
+      fs::remove(path);
+      modlog::UringFileSink file;
+      file.buffer_size = 1024;
+      file.use_uring = uring;
+      expect(file.open(path.string()));
+      if (!uring) expect(!file.uring_active());
+      std::string expected;
+      for (int k = 0; k < 2000; k++) {
+        std::string rec = "uring record " + std::to_string(k) + "\n";
+        file.write(k % 500 ? Info : Warning, rec);
+        expected += rec;
+      }
+      file.write(Info, std::string(3000, 'x') + "\n");  // larger than buffer
+      expected += std::string(3000, 'x') + "\n";
+      file.close();
+      std::ifstream f{path};
+      std::string got{std::istreambuf_iterator<char>{f}, {}};
+      expect(got == expected);
+    }
+    fs::remove(path);
+  };
+#endif
+
   return 0;
 }
@@ -0,0 +1,29 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2025 - modlog library - https://github.com/igormcoelho/modlog
+
+// Prints log files written by modlog, decompressing LZ4 files (see
+// FileSink::compress), so they can be piped to grep and friends.
+// Usage: modlog_cat <log file>...
+
+#include <iostream>
+#include <string>
+//
+#include <modlog/modlog.hpp>
+
+auto main(int argc, char* argv[]) -> int {
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " <log file>..." << std::endl;
+    return 2;
+  }
+  int status = 0;
+  for (int i = 1; i < argc; i++) {
+    std::ifstream f{argv[i]};
+    if (!f) {
+      std::cerr << argv[0] << ": cannot open '" << argv[i] << "'" << std::endl;
+      status = 1;
+      continue;
+    }
+    std::cout << modlog::read_log_file(argv[i]);
+  }
+  return status;
+}
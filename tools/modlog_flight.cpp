@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2025 - modlog library - https://github.com/igormcoelho/modlog
+
+// Prints records kept by a crash flight recorder (see StartFlightRecorder),
+// from oldest to newest, also after a crash or kill -9 of its process.
+// Usage: modlog_flight <ring file>
+
+#include <iostream>
+#include <string>
+//
+#include <modlog/modlog.hpp>
+
+auto main(int argc, char* argv[]) -> int {
+  if (argc != 2) {
+    std::cerr << "usage: " << argv[0] << " <ring file>" << std::endl;
+    return 2;
+  }
+  std::ifstream f{argv[1]};
+  if (!f) {
+    std::cerr << argv[0] << ": cannot open '" << argv[1] << "'" << std::endl;
+    return 1;
+  }
+  std::string records = modlog::FlightRecorder::recover(argv[1]);
+  if (records.empty()) {
+    std::cerr << argv[0] << ": no records on '" << argv[1] << "'"
+              << std::endl;
+    return 1;
+  }
+  std::cout << records;
+  return 0;
+}
@@ -0,0 +1,213 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2025 - modlog library - https://github.com/igormcoelho/modlog
+
+// Prints records of modlog files (text, NDJSON, logfmt, binary or LZ4, see
+// LogFileView) filtered by level letters, time range, caller and message
+// substring. The substring is searched on the whole mapped file with SIMD,
+// and only records around a match are parsed; on binary files, the time
+// index skips segments out of range.
+// Usage: modlog_grep [-l DIWEF] [-f from] [-t to] [-c file[:line]]
+//                    [-e text] <log file>...
+// (times as "20250415 10:42" or "2025-04-15T10:42:00.5", local time)
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#if defined(__GNUC__) && defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+//
+#include <modlog/modlog.hpp>
+
+// first position of 'needle' in 'hay' from 'pos' (npos if none): first and
+// last bytes of 'needle' are compared on 32 (AVX2) or 16 (SSE2) positions at
+// once, and the whole needle only on positions where both match
+std::size_t find_simd(std::string_view hay, std::string_view needle,
+                      std::size_t pos) {
+  std::size_t n = needle.size();
+  if (n < 2 || hay.size() < n) return hay.find(needle, pos);
+  const char* s = hay.data();
+  std::size_t end = hay.size() - n + 1;  // candidate positions
+  std::size_t i = pos;
+#if defined(__GNUC__) && defined(__AVX2__)
+  const __m256i first = _mm256_set1_epi8(needle[0]);
+  const __m256i last = _mm256_set1_epi8(needle[n - 1]);
+  for (; i + 32 <= end; i += 32) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+    __m256i b =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i + n - 1));
+    auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_and_si256(
+        _mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+    for (; mask; mask &= mask - 1) {
+      std::size_t k = i + static_cast<std::size_t>(__builtin_ctz(mask));
+      if (std::memcmp(s + k + 1, needle.data() + 1, n - 2) == 0) return k;
+    }
+  }
+#elif defined(__GNUC__) && defined(__SSE2__)
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[n - 1]);
+  for (; i + 16 <= end; i += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+    __m128i b =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + n - 1));
+    auto mask = static_cast<unsigned>(_mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+    for (; mask; mask &= mask - 1) {
+      std::size_t k = i + static_cast<std::size_t>(__builtin_ctz(mask));
+      if (std::memcmp(s + k + 1, needle.data() + 1, n - 2) == 0) return k;
+    }
+  }
+#endif
+  return hay.find(needle, i);
+}
+
+struct Filter {
+  std::string levels;  // letters, empty for all
+  std::int64_t from{std::numeric_limits<std::int64_t>::min()};
+  std::int64_t to{std::numeric_limits<std::int64_t>::max()};
+  std::string file;
+  int line{0};  // 0 for any
+  std::string text;
+
+  // all but 'text'
+  bool accepts(const modlog::LogRecordView& r) const {
+    if (!levels.empty() && levels.find(letter(r.level)) == std::string::npos)
+      return false;
+    if (r.time < from || r.time >= to) return false;
+    if (!file.empty() && (r.file != file || (line && r.line != line)))
+      return false;
+    return true;
+  }
+
+  static char letter(modlog::LogLevel l) {
+    if (l == modlog::LogLevel::Debug) return 'D';
+    if (l == modlog::LogLevel::Warning) return 'W';
+    if (l == modlog::LogLevel::Error) return 'E';
+    if (l == modlog::LogLevel::Fatal) return 'F';
+    return 'I';
+  }
+};
+
+// binary records are printed as default_prefix_data does (with no thread)
+void print_binary(const modlog::LogRecordView& r) {
+  std::int64_t us = r.time % 1'000'000, secs = r.time / 1'000'000;
+  if (us < 0) us += 1'000'000, secs--;
+  std::int64_t days = secs / 86400, rem = secs % 86400;
+  if (rem < 0) rem += 86400, days--;
+  // civil date from days since 1970-01-01
+  std::int64_t z = days + 719468;
+  std::int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+  std::int64_t doe = z - era * 146097;
+  std::int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  std::int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  std::int64_t mp = (5 * doy + 2) / 153;
+  std::int64_t d = doy - (153 * mp + 2) / 5 + 1;
+  std::int64_t m = mp < 10 ? mp + 3 : mp - 9;
+  std::int64_t y = yoe + era * 400 + (m <= 2);
+  std::printf("%c%04lld%02lld%02lld %02lld:%02lld:%02lld.%06lld"
+              " %.*s:%d] %.*s\n",
+              Filter::letter(r.level), static_cast<long long>(y),
+              static_cast<long long>(m), static_cast<long long>(d),
+              static_cast<long long>(rem / 3600),
+              static_cast<long long>(rem / 60 % 60),
+              static_cast<long long>(rem % 60), static_cast<long long>(us),
+              static_cast<int>(r.file.size()), r.file.data(), r.line,
+              static_cast<int>(r.msg.size()), r.msg.data());
+}
+
+// prints matching records of 'path', returning how many
+long grep(const std::string& path, const Filter& filter) {
+  modlog::LogFileView view;
+  if (!view.open(path)) {
+    std::cerr << "modlog_grep: cannot open '" << path << "'" << std::endl;
+    return -1;
+  }
+  long count = 0;
+  auto print = [&](const modlog::LogRecordView& r) {
+    if (view.format() == modlog::LogFileFormat::Binary)
+      print_binary(r);
+    else
+      std::fwrite(r.text.data(), 1, r.text.size(), stdout);
+    count++;
+  };
+  std::string_view data = view.data();
+  if (filter.text.empty() || view.format() == modlog::LogFileFormat::Binary) {
+    view.for_range(filter.from, filter.to, [&](const auto& r) {
+      if (filter.accepts(r) &&
+          (filter.text.empty() || find_simd(r.msg, filter.text, 0) !=
+                                      std::string_view::npos))
+        print(r);
+    });
+    return count;
+  }
+  // search whole file, then parse only records with a match
+  std::size_t pos = 0;
+  while ((pos = find_simd(data, filter.text, pos)) != std::string_view::npos) {
+    auto r = view.record_at(pos);
+    if (r.text.empty()) {  // before first record (e.g., file header)
+      pos++;
+      continue;
+    }
+    // (match may be on prefix, so message is checked again)
+    if (filter.accepts(r) &&
+        find_simd(r.msg, filter.text, 0) != std::string_view::npos)
+      print(r);
+    pos = static_cast<std::size_t>(r.text.data() - data.data()) +
+          r.text.size();
+  }
+  return count;
+}
+
+auto main(int argc, char* argv[]) -> int {
+  Filter filter;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++) {
+    std::string_view a = argv[i];
+    bool value = a.size() == 2 && a[0] == '-' && i + 1 < argc;
+    if (value && a == "-l") {
+      filter.levels = argv[++i];
+    } else if (value && (a == "-f" || a == "-t")) {
+      if (!modlog::parse_wall_time(argv[++i],
+                                   a == "-f" ? filter.from : filter.to)) {
+        std::cerr << "modlog_grep: bad time '" << argv[i] << "'" << std::endl;
+        return 2;
+      }
+    } else if (value && a == "-c") {
+      filter.file = argv[++i];
+      auto colon = filter.file.rfind(':');
+      if (colon != std::string::npos) {
+        filter.line = std::atoi(filter.file.c_str() + colon + 1);
+        filter.file.resize(colon);
+      }
+    } else if (value && a == "-e") {
+      filter.text = argv[++i];
+    } else if (!a.empty() && a[0] == '-') {
+      files.clear();
+      break;
+    } else {
+      files.emplace_back(a);
+    }
+  }
+  if (files.empty()) {
+    std::cerr << "usage: " << argv[0]
+              << " [-l DIWEF] [-f from] [-t to] [-c file[:line]] [-e text]"
+                 " <log file>..."
+              << std::endl;
+    return 2;
+  }
+  long total = 0;
+  bool failed = false;
+  for (const auto& f : files) {
+    long n = grep(f, filter);
+    if (n < 0)
+      failed = true;
+    else
+      total += n;
+  }
+  std::fflush(stdout);
+  return failed ? 2 : (total > 0 ? 0 : 1);
+}